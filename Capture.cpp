@@ -0,0 +1,148 @@
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Capture.h"
+#include "Interpreter.h"
+#include "Jobs.h"
+#include "Trace.h"
+#include "Variables.h"
+
+namespace BShell {
+// Default cap on the size of a single command substitution.
+constexpr size_t CAPTURE_LIMIT = 256 << 20;
+
+size_t capture$limit() {
+    // BSHELL_CAPTURE_MAX overrides the cap (in bytes), 0 disables it.
+    auto* buf = var$get("BSHELL_CAPTURE_MAX");
+
+    if (buf == nullptr || !*buf)
+        return CAPTURE_LIMIT;
+
+    auto limit = strtoull(buf, nullptr, 10);
+
+    return limit ? limit : SIZE_MAX;
+}
+
+Capture capture$spawn(std::function<void()> body) {
+    // Run body in a subshell whose stdout is a pipe back to us. The subshell
+    // does its own waiting, the parent only has to keep the pipe drained.
+    auto io = Pipe {};
+
+    if (pipe(io.fd) < 0) {
+        perror("pipe()");
+        exit(1);
+    }
+
+    std::cout.flush();
+
+    auto pid = fork();
+
+    if (pid < 0) {
+        perror("fork()");
+        exit(1);
+    } else if (!pid) {
+        dup2(io.fd[1], STDOUT_FILENO);
+
+        close(io.fd[0]);
+        close(io.fd[1]);
+
+        jobs$subshell();
+        body();
+
+        std::cout.flush();
+        _exit(g_exit_fg);
+    }
+
+    close(io.fd[1]);
+
+    return Capture { pid, io.fd[0], 0, false, {} };
+}
+
+void capture$drain(std::vector<Capture>& captures) {
+    TRACE_SCOPE("capture");
+
+    // Read every capture until EOF, reading straight into the result buffers
+    // while the subshells are still running.
+    auto limit = capture$limit();
+    auto fds = std::vector<pollfd> {};
+
+    for (auto const& capture : captures)
+        fds.push_back(pollfd { capture.fd, POLLIN, 0 });
+
+    auto open = fds.size();
+
+    while (open) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            perror("poll()");
+            exit(1);
+        }
+
+        for (auto i = size_t {}; i < fds.size(); i++) {
+            if (fds[i].fd < 0 || !fds[i].revents)
+                continue;
+
+            auto& capture = captures[i];
+            auto& out = capture.output;
+            auto size = out.size();
+
+            // Grow geometrically so the buffer is copied O(log n) times.
+            if (out.capacity() - size < BUFSIZ)
+                out.reserve(std::max(out.capacity() * 2, size + BUFSIZ));
+
+            out.resize(out.capacity());
+
+            auto count = read(fds[i].fd, out.data() + size, out.size() - size);
+
+            if (count < 0 && errno == EINTR)
+                count = 0;
+
+            if (count < 0)
+                perror("read()");
+
+            out.resize(size + std::max(count, ssize_t {}));
+
+            if (out.size() > limit) {
+                // Keep draining so the subshell is never blocked on a full pipe.
+                if (!capture.truncated)
+                    std::cerr << "Command substitution output truncated to " << limit
+                              << " bytes.\n";
+
+                capture.truncated = true;
+                out.resize(limit);
+            }
+
+            if (count <= 0) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                open--;
+            }
+        }
+    }
+
+    for (auto& capture : captures) {
+        auto status = 0;
+
+        if (waitpid(capture.pid, &status, 0) < 0)
+            perror("waitpid()");
+
+        capture.status = exit$status(status);
+
+        // POSIX: trailing newlines are removed from the substitution result.
+        auto end = capture.output.find_last_not_of('\n');
+        capture.output.resize(end == std::string::npos ? 0 : end + 1);
+    }
+}
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace BShell {
+struct Capture {
+    pid_t pid;
+    int fd;
+    int status;
+    bool truncated;
+    std::string output;
+};
+
+Capture capture$spawn(std::function<void()>);
+void capture$drain(std::vector<Capture>&);
+size_t capture$limit();
+}
@@ -0,0 +1,171 @@
+#include <functional>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CommandTable.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+#include "Variables.h"
+
+namespace BShell {
+struct HashEntry {
+    std::string path; // empty for words that are not commands
+    size_t hits;
+};
+
+struct HashDir {
+    std::string path;
+    timespec mtime;
+};
+
+std::unordered_map<std::string, HashEntry, StringHash, std::equal_to<>> g_hash;
+std::vector<HashDir> g_hash_dirs;
+std::string g_hash_env_path;
+std::string const g_hash_none;
+size_t g_hash_hits = 0, g_hash_misses = 0;
+
+timespec hash$mtime(std::string const& dir) {
+    struct stat st { };
+
+    if (stat(dir.c_str(), &st) < 0)
+        return timespec {};
+
+    return st.st_mtim;
+}
+
+void hash$sync_path() {
+    // Rebuild the directory list only when $PATH itself changes.
+    auto* buf = var$get("PATH");
+    auto env_path = std::string_view { buf ? buf : "" };
+
+    if (env_path == g_hash_env_path && (g_hash_dirs.size() || env_path.empty()))
+        return;
+
+    g_hash_env_path = env_path;
+    g_hash_dirs.clear();
+    g_hash.clear();
+
+    for (auto i = size_t {}; i <= env_path.size();) {
+        auto j = env_path.find(':', i);
+
+        if (j == std::string_view::npos)
+            j = env_path.size();
+
+        // POSIX: an empty PATH entry means the current directory.
+        auto dir = std::string { j > i ? env_path.substr(i, j - i) : "." };
+
+        g_hash_dirs.push_back(HashDir { dir, hash$mtime(dir) });
+
+        i = j + 1;
+    }
+}
+
+void hash$revalidate() {
+    TRACE_SCOPE("hash");
+
+    // Called once per prompt instead of per lookup, adding or removing a file in
+    // a PATH directory bumps its mtime and drops every cached answer.
+    hash$sync_path();
+
+    for (auto& dir : g_hash_dirs) {
+        auto mtime = hash$mtime(dir.path);
+
+        if (mtime.tv_sec != dir.mtime.tv_sec || mtime.tv_nsec != dir.mtime.tv_nsec) {
+            dir.mtime = mtime;
+            g_hash.clear();
+        }
+    }
+}
+
+uint64_t hash$stamp() {
+    // Changes whenever hash$revalidate would drop the table, so anything derived from
+    // lookups can be keyed on it.
+    hash$revalidate();
+
+    auto stamp = std::hash<std::string_view> {}(g_hash_env_path);
+
+    for (auto const& dir : g_hash_dirs) {
+        stamp = stamp * 31 + dir.mtime.tv_sec;
+        stamp = stamp * 31 + dir.mtime.tv_nsec;
+    }
+
+    return stamp;
+}
+
+std::vector<std::string> hash$dirs() {
+    hash$sync_path();
+
+    auto dirs = std::vector<std::string> {};
+
+    for (auto const& dir : g_hash_dirs)
+        dirs.push_back(dir.path);
+
+    return dirs;
+}
+
+std::string const& hash$lookup(std::string_view cmd) {
+    // Scans the path for executables that match the given string, remembering
+    // both hits and misses.
+    if (cmd.find('/') != std::string_view::npos) {
+        static auto path = std::string {};
+        path = cmd;
+
+        return access(path.c_str(), X_OK) != -1 ? path : g_hash_none;
+    }
+
+    hash$sync_path();
+
+    // Misses are trusted like hits until the next hash$revalidate, which runs once per
+    // prompt and once per script statement, never per lookup.
+    if (auto entry = g_hash.find(cmd); entry != g_hash.end()) {
+        g_hash_hits++;
+        entry->second.hits++;
+
+        return entry->second.path;
+    }
+
+    g_hash_misses++;
+
+    auto path = std::string {};
+
+    for (auto const& dir : g_hash_dirs) {
+        auto tmp = dir.path + '/';
+        tmp += cmd;
+
+        if (access(tmp.c_str(), X_OK) != -1) {
+            path = std::move(tmp);
+            break;
+        }
+    }
+
+    return g_hash.emplace(cmd, HashEntry { std::move(path), 0 }).first->second.path;
+}
+
+void hash$clear() {
+    g_hash.clear();
+    g_hash_hits = g_hash_misses = 0;
+}
+
+void hash$print() {
+    auto negative = size_t {};
+
+    for (auto const& [name, entry] : g_hash) {
+        if (!entry.path.size()) {
+            negative++;
+            continue;
+        }
+
+        std::cout << entry.hits << '\t' << entry.path << '\n';
+    }
+
+    std::cout << "hits " << g_hash_hits << ", misses " << g_hash_misses << ", negative entries "
+              << negative << '\n';
+}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace BShell {
+std::string const& hash$lookup(std::string_view);
+void hash$revalidate();
+uint64_t hash$stamp();
+std::vector<std::string> hash$dirs();
+void hash$clear();
+void hash$print();
+}
@@ -1,73 +1,1014 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "CommandTable.h"
 #include "Commands.h"
+#include "Functions.h"
 #include "Interpreter.h"
 #include "Parser.h"
+#include "PromptString.h"
 #include "System.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+#include "Variables.h"
 
 namespace BShell {
-std::string g_prev_wd = "";
+std::vector<std::string> g_dir_stack; // pushd/popd, the top is at the back
 
-void command$cd(std::shared_ptr<Expression> const& expr) {
-    auto args = std::vector<std::string> {};
-    auto argv = std::vector<char*> {};
+std::string command$cd_target(std::string const& dir) {
+    if (dir.empty())
+        return get$home();
 
-    auto sticky = false;
+    if (dir[0] == '~')
+        return get$home() + dir.substr(1);
 
-    for (auto const& child : expr->children)
-        handle$argv_strings(args, sticky, child->token);
+    if (dir == "-")
+        return g_prev_wd;
 
-    std::transform(args.begin(), args.end(), std::back_inserter(argv),
-                   [](std::string const& str) { return const_cast<char*>(str.c_str()); });
+    return dir;
+}
 
-    auto* dir = argv.size() ? argv[0] : nullptr;
-    auto cwd = get$cwd();
-    auto stat = 0;
+bool command$chdir(std::string const& dir) {
+    if (dir.empty()) {
+        std::cerr << "cd: OLDPWD not set\n";
+        return false;
+    }
+
+    // Don't change previous directory on error.
+    if (!set$cwd(dir)) {
+        perror("chdir()");
+        return false;
+    }
+
+    return true;
+}
+
+int command$cd(Args const& args) {
+    return !command$chdir(command$cd_target(args.size() > 1 ? args[1] : ""));
+}
+
+int command$pwd(Args const& args) {
+    auto physical = false;
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        if (args[i] == "-P") {
+            physical = true;
+        } else if (args[i] == "-L") {
+            physical = false;
+        } else {
+            std::cerr << "pwd: " << args[i] << ": invalid option\n";
+            return 2;
+        }
+    }
+
+    std::cout << (physical ? get$cwd_physical() : get$cwd()) << '\n';
+
+    return 0;
+}
+
+int command$dirs(Args const&) {
+    // The current directory first, then the stack from the top down.
+    auto home = get$home();
+    auto print = [&](std::string const& dir) {
+        if (dir.starts_with(home) && (dir.size() == home.size() || dir[home.size()] == '/'))
+            std::cout << '~' << dir.substr(home.size());
+        else
+            std::cout << dir;
+    };
 
-    if (!dir) {
-        stat = chdir(get$home().c_str());
-    } else if (dir[0] == '~') {
-        auto home = get$home();
-        auto path = std::make_unique<char>(strlen(dir) + home.size());
+    print(get$cwd());
 
-        strcpy(path.get(), home.c_str());
-        strcpy(path.get() + home.size(), dir + 1);
+    for (auto it = g_dir_stack.rbegin(); it != g_dir_stack.rend(); it++) {
+        std::cout << ' ';
+        print(*it);
+    }
+
+    std::cout << '\n';
+
+    return 0;
+}
+
+int command$pushd(Args const& args) {
+    auto cwd = get$cwd();
 
-        stat = chdir(path.get());
-    } else if (strcmp(dir, "-") == 0) {
-        if (!g_prev_wd.size()) {
-            std::cerr << "g_prev_wd not set\n";
-            return;
+    if (args.size() < 2) {
+        // Swap the two topmost directories.
+        if (g_dir_stack.empty()) {
+            std::cerr << "pushd: no other directory\n";
+            return 1;
         }
 
-        stat = chdir(g_prev_wd.c_str());
+        if (!command$chdir(g_dir_stack.back()))
+            return 1;
+
+        g_dir_stack.back() = std::move(cwd);
     } else {
-        stat = chdir(dir);
+        if (!command$chdir(command$cd_target(args[1])))
+            return 1;
+
+        g_dir_stack.push_back(std::move(cwd));
     }
 
-    // Don't change previous directory on error.
-    if (stat < 0) {
-        perror("chdir()");
-        return;
+    return command$dirs(args);
+}
+
+int command$popd(Args const& args) {
+    if (g_dir_stack.empty()) {
+        std::cerr << "popd: directory stack empty\n";
+        return 1;
     }
 
-    g_prev_wd = cwd;
+    if (!command$chdir(g_dir_stack.back()))
+        return 1;
+
+    g_dir_stack.pop_back();
+
+    return command$dirs(args);
 }
 
-void command$set_env(std::shared_ptr<Expression> const& expr) {
-    if (expr->children.size() < 2) {
+void command$assign(std::string_view name, std::string_view value, bool exported) {
+    var$set(name, value, exported);
+
+    // The prompt is recompiled here rather than checked for on every prompt.
+    if (name == "PS1")
+        set$PS1(std::string { value });
+}
+
+void command$set_env(Expression const& expr) {
+    if (expr.size() < 2) {
         std::cerr << "Syntax error '='.\n";
         return;
     }
 
-    auto key = expr->children[0]->token.content;
-    auto val = expr->children[1]->token.content;
+    auto name = expr.child(0).content();
+
+    if (!var$valid(name)) {
+        std::cerr << name << ": not a valid identifier\n";
+        return;
+    }
+
+    auto value = expr.child(1);
+
+    command$assign(name, value.type() == Eval ? get$eval(value) : handle$word(value), false);
+}
+
+int command$export(Args const& args) {
+    auto status = 0;
+
+    if (args.size() < 2 || args[1] == "-p") {
+        auto names = var$names();
+
+        std::sort(names.begin(), names.end());
+
+        for (auto name : names)
+            if (var$exported(name))
+                std::cout << "export " << name << "=\"" << var$get(name) << "\"\n";
+
+        return status;
+    }
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        auto arg = std::string_view { args[i] };
+        auto equal = arg.find('=');
+        auto name = arg.substr(0, equal);
+
+        if (!var$valid(name)) {
+            std::cerr << "export: " << arg << ": not a valid identifier\n";
+            status = 1;
+        } else if (equal != std::string_view::npos) {
+            command$assign(name, arg.substr(equal + 1), true);
+        } else {
+            var$export(name);
+        }
+    }
+
+    return status;
+}
+
+int command$unset(Args const& args) {
+    auto status = 0;
+    auto functions = args.size() > 1 && args[1] == "-f";
+
+    for (auto i = size_t { 1 } + functions; i < args.size(); i++) {
+        if (functions) {
+            function$unset(args[i]);
+        } else if (var$valid(args[i])) {
+            var$unset(args[i]);
+        } else {
+            std::cerr << "unset: " << args[i] << ": not a valid identifier\n";
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+int command$loop(Args const& args, bool next) {
+    // break [n] and continue [n] only leave a note, the lists and loops they are in stop
+    // once the builtin returns.
+    auto count = 1ll;
+    auto* end = static_cast<char*>(nullptr);
+
+    if (args.size() > 1 && ((count = strtoll(args[1].c_str(), &end, 10)) < 1 || *end)) {
+        std::cerr << args[0] << ": " << args[1] << ": loop count out of range\n";
+        return 1;
+    }
+
+    if (!g_loop_depth) {
+        std::cerr << args[0] << ": only meaningful in a loop\n";
+        return 0;
+    }
+
+    g_loop_break = static_cast<int>(std::min<long long>(count, g_loop_depth)) - next;
+    g_loop_continue = next;
+
+    return 0;
+}
+
+int command$break(Args const& args) { return command$loop(args, false); }
+
+int command$continue(Args const& args) { return command$loop(args, true); }
+
+int command$return(Args const& args) {
+    auto status = static_cast<long long>(g_exit_fg);
+    auto* end = static_cast<char*>(nullptr);
+
+    if (!g_function_depth) {
+        std::cerr << "return: can only return from a function\n";
+        return 1;
+    }
+
+    if (args.size() > 1 && ((status = strtoll(args[1].c_str(), &end, 10)), *end)) {
+        std::cerr << "return: " << args[1] << ": numeric argument required\n";
+        status = 2;
+    }
+
+    g_function_return = true;
+
+    return static_cast<int>(status & 0xFF);
+}
+
+int command$exit(Args const& args) {
+    // Like return, the lists being run stop and whoever runs statements then stops
+    // too. In a fork of the shell that just ends the fork with the status.
+    auto status = static_cast<long long>(g_exit_fg);
+    auto* end = static_cast<char*>(nullptr);
+
+    if (args.size() > 1 && ((status = strtoll(args[1].c_str(), &end, 10)), *end)) {
+        std::cerr << "exit: " << args[1] << ": numeric argument required\n";
+        status = 2;
+    }
+
+    g_shell_exit = true;
+
+    return static_cast<int>(status & 0xFF);
+}
+
+std::string command$quote(std::string_view text) {
+    // Single quoted the way other shells print aliases.
+    auto quoted = std::string { "'" };
+
+    for (auto c : text) {
+        if (c == '\'')
+            quoted += "'\\''";
+        else
+            quoted += c;
+    }
+
+    return quoted + '\'';
+}
+
+int command$alias(Args const& args) {
+    auto status = 0;
+
+    if (args.size() < 2) {
+        auto names = alias$names();
+
+        std::sort(names.begin(), names.end());
+
+        for (auto name : names)
+            std::cout << "alias " << name << '=' << command$quote(alias$find(name)->text) << '\n';
+
+        return status;
+    }
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        auto const& arg = args[i];
+        auto equal = arg.find('=');
+
+        if (equal != std::string::npos && equal) {
+            alias$define(std::string_view { arg }.substr(0, equal),
+                         std::string_view { arg }.substr(equal + 1));
+        } else if (auto const* alias = alias$find(arg)) {
+            std::cout << "alias " << arg << '=' << command$quote(alias->text) << '\n';
+        } else {
+            std::cerr << "alias: " << arg << ": not found\n";
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+int command$unalias(Args const& args) {
+    auto status = 0;
+
+    if (args.size() < 2) {
+        std::cerr << "unalias: usage: unalias [-a] name [name ...]\n";
+        return 2;
+    }
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        if (args[i] == "-a") {
+            alias$clear();
+        } else if (!alias$remove(args[i])) {
+            std::cerr << "unalias: " << args[i] << ": not found\n";
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+int command$hash(Args const& args) {
+    if (args.size() < 2) {
+        hash$print();
+        return 0;
+    }
+
+    auto status = 0;
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        if (args[i] == "-r") {
+            hash$clear();
+        } else if (!hash$lookup(args[i]).size()) {
+            std::cerr << "hash: " << args[i] << ": not found\n";
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+Job* command$job(Args const& args) {
+    auto* job = args.size() > 1 ? jobs$find(args[1]) : jobs$current();
+
+    if (!job)
+        std::cerr << args[0] << ": " << (args.size() > 1 ? args[1] : "current")
+                  << ": no such job\n";
+
+    return job;
+}
+
+int command$jobs(Args const&) {
+    jobs$print();
+    return 0;
+}
+
+int command$wait(Args const& args) {
+    auto status = 0;
+
+    jobs$poll();
+
+    if (args.size() < 2) {
+        // Wait for every background job.
+        while (auto* job = jobs$current()) {
+            auto taken = jobs$take(*job);
+            status = jobs$wait(taken, false);
+        }
+
+        return status;
+    }
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        auto* job = jobs$find(args[i]);
+
+        if (!job) {
+            std::cerr << "wait: " << args[i] << ": no such job\n";
+            status = 127;
+            continue;
+        }
+
+        auto taken = jobs$take(*job);
+        status = jobs$wait(taken, false);
+    }
+
+    return status;
+}
+
+int command$fg(Args const& args) {
+    auto* job = command$job(args);
+
+    if (!job)
+        return 1;
+
+    auto taken = jobs$take(*job);
+
+    std::cout << taken.name << '\n';
+
+    if (g_job_control)
+        tcsetpgrp(STDIN_FILENO, taken.pgid);
+
+    jobs$continue(taken);
+
+    return jobs$foreground(taken);
+}
+
+int command$bg(Args const& args) {
+    auto* job = command$job(args);
+
+    if (!job)
+        return 1;
+
+    if (jobs$continue(*job))
+        std::cout << '[' << job->id << "] " << job->name << " &\n";
+
+    return 0;
+}
+
+int command$true(Args const&) { return 0; }
+
+int command$false(Args const&) { return 1; }
+
+bool command$escape(std::string_view& text, std::string& out) {
+    // Decodes the backslash escape at the front of text for echo -e and printf.
+    // Returns false on \c, which ends all output.
+    text.remove_prefix(1);
+
+    if (text.empty()) {
+        out += '\\';
+        return true;
+    }
+
+    auto c = text[0];
+    text.remove_prefix(1);
+
+    switch (c) {
+    case 'a':
+        out += '\a';
+        break;
+    case 'b':
+        out += '\b';
+        break;
+    case 'c':
+        return false;
+    case 'e':
+        out += '\x1b';
+        break;
+    case 'f':
+        out += '\f';
+        break;
+    case 'n':
+        out += '\n';
+        break;
+    case 'r':
+        out += '\r';
+        break;
+    case 't':
+        out += '\t';
+        break;
+    case 'v':
+        out += '\v';
+        break;
+    case '\\':
+        out += '\\';
+        break;
+    case '0': {
+        // Up to three octal digits follow.
+        auto value = 0;
+
+        for (auto i = 0; i < 3 && text.size() && text[0] >= '0' && text[0] <= '7'; i++) {
+            value = value * 8 + (text[0] - '0');
+            text.remove_prefix(1);
+        }
+
+        out += static_cast<char>(value);
+    } break;
+    default:
+        out += '\\';
+        out += c;
+    }
+
+    return true;
+}
+
+int command$echo(Args const& args) {
+    auto newline = true, escapes = false;
+    auto i = size_t { 1 };
+
+    // Options are only recognized before the first operand, and only if every
+    // character is one of n, e and E.
+    for (; i < args.size(); i++) {
+        auto const& arg = args[i];
+
+        if (arg.size() < 2 || arg[0] != '-' || arg.find_first_not_of("neE", 1) != std::string::npos)
+            break;
+
+        for (auto c : std::string_view { arg }.substr(1)) {
+            if (c == 'n')
+                newline = false;
+            else
+                escapes = c == 'e';
+        }
+    }
+
+    auto out = std::string {};
+
+    for (auto first = i; i < args.size(); i++) {
+        if (i > first)
+            out += ' ';
+
+        if (!escapes) {
+            out += args[i];
+            continue;
+        }
+
+        for (auto text = std::string_view { args[i] }; text.size();) {
+            if (text[0] != '\\') {
+                out += text[0];
+                text.remove_prefix(1);
+            } else if (!command$escape(text, out)) {
+                std::cout << out;
+                return 0;
+            }
+        }
+    }
+
+    if (newline)
+        out += '\n';
+
+    std::cout << out;
+
+    return 0;
+}
+
+bool command$number(std::string const& arg, long long& value) {
+    // printf also takes 'c and "c for the value of a character.
+    if (arg.size() >= 2 && (arg[0] == '\'' || arg[0] == '"')) {
+        value = static_cast<unsigned char>(arg[1]);
+        return true;
+    }
+
+    auto* end = static_cast<char*>(nullptr);
+    value = strtoll(arg.c_str(), &end, 0);
+
+    return arg.empty() || *end == '\0';
+}
+
+int command$printf(Args const& args) {
+    if (args.size() < 2) {
+        std::cerr << "printf: usage: printf format [arguments]\n";
+        return 2;
+    }
+
+    auto status = 0;
+    auto out = std::string {};
+    auto next = size_t { 2 };
+
+    auto argument = [&]() -> std::string const& {
+        static auto const empty = std::string {};
+        return next < args.size() ? args[next++] : empty;
+    };
+
+    // The format is reused until every argument has been consumed.
+    do {
+        auto start = next;
+        auto format = std::string_view { args[1] };
+
+        while (format.size()) {
+            if (format[0] == '\\') {
+                if (!command$escape(format, out)) {
+                    std::cout << out;
+                    return status;
+                }
+
+                continue;
+            }
+
+            if (format[0] != '%' || format.size() < 2) {
+                out += format[0];
+                format.remove_prefix(1);
+                continue;
+            }
+
+            if (format[1] == '%') {
+                out += '%';
+                format.remove_prefix(2);
+                continue;
+            }
+
+            // Flags, width and precision are passed through to snprintf.
+            auto length = format.find_first_not_of("-+ #0123456789.*", 1);
+
+            if (length == std::string_view::npos) {
+                out += format;
+                break;
+            }
+
+            auto spec = std::string { format.substr(0, length) };
+            auto conversion = format[length];
+            char buf[512];
+
+            format.remove_prefix(length + 1);
+
+            // A * in the spec takes its value from the next argument.
+            for (auto star = spec.find('*'); star != std::string::npos; star = spec.find('*')) {
+                auto value = 0LL;
+                command$number(argument(), value);
+                spec.replace(star, 1, std::to_string(value));
+            }
+
+            switch (conversion) {
+            case 'd':
+            case 'i':
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X': {
+                auto const& arg = argument();
+                auto value = 0LL;
+
+                if (!command$number(arg, value)) {
+                    std::cerr << "printf: " << arg << ": invalid number\n";
+                    status = 1;
+                }
+
+                spec += "ll";
+                spec += conversion;
+                out.append(buf, std::min(sizeof(buf) - 1,
+                                         size_t(snprintf(buf, sizeof(buf), spec.c_str(), value))));
+            } break;
+            case 'e':
+            case 'E':
+            case 'f':
+            case 'F':
+            case 'g':
+            case 'G': {
+                auto const& arg = argument();
+                auto* end = static_cast<char*>(nullptr);
+                auto value = strtod(arg.c_str(), &end);
+
+                if (arg.size() && *end) {
+                    std::cerr << "printf: " << arg << ": invalid number\n";
+                    status = 1;
+                }
+
+                spec += conversion;
+                out.append(buf, std::min(sizeof(buf) - 1,
+                                         size_t(snprintf(buf, sizeof(buf), spec.c_str(), value))));
+            } break;
+            case 'c':
+                if (auto const& arg = argument(); arg.size())
+                    out += arg[0];
+                break;
+            case 's':
+            case 'b': {
+                auto text = argument();
+
+                if (conversion == 'b') {
+                    auto expanded = std::string {};
+
+                    for (auto view = std::string_view { text }; view.size();) {
+                        if (view[0] != '\\') {
+                            expanded += view[0];
+                            view.remove_prefix(1);
+                        } else if (!command$escape(view, expanded)) {
+                            break;
+                        }
+                    }
+
+                    text = std::move(expanded);
+                }
+
+                spec += 's';
+
+                if (spec == "%s") {
+                    out += text;
+                    break;
+                }
+
+                auto size = snprintf(nullptr, 0, spec.c_str(), text.c_str());
+                auto formatted = std::string(size, '\0');
+
+                snprintf(formatted.data(), size + 1, spec.c_str(), text.c_str());
+                out += formatted;
+            } break;
+            default:
+                std::cerr << "printf: %" << conversion << ": invalid directive\n";
+                std::cout << out;
+                return 1;
+            }
+        }
+
+        if (next == start)
+            break;
+    } while (next < args.size());
+
+    std::cout << out;
+
+    return status;
+}
+
+// test and [, evaluated by recursive descent over the arguments:
+//   expr := and ( -o and )*    and := not ( -a not )*    not := ! not | primary
+struct TestParser {
+    Args const& args;
+    size_t pos, end;
+    bool error;
+
+    bool more() const { return pos < end; }
+    std::string const& peek(size_t ahead = 0) const { return args[pos + ahead]; }
+
+    static bool unary(std::string const& op) {
+        return op.size() == 2 && op[0] == '-' && strchr("bcdefghLnprsStwxz", op[1]);
+    }
+
+    static bool binary(std::string const& op) {
+        for (auto const* known : { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt",
+                                   "-ge", "-nt", "-ot", "-ef" })
+            if (op == known)
+                return true;
+
+        return false;
+    }
+
+    long long integer(std::string const& arg) {
+        auto* end = static_cast<char*>(nullptr);
+        auto value = strtoll(arg.c_str(), &end, 10);
+
+        if (arg.empty() || *end) {
+            std::cerr << "test: " << arg << ": integer expression expected\n";
+            error = true;
+        }
+
+        return value;
+    }
+
+    bool evaluate_unary(char op, std::string const& operand) {
+        struct stat st;
+
+        if (op == 'z')
+            return operand.empty();
+
+        if (op == 'n')
+            return operand.size();
+
+        if (op == 't')
+            return isatty(static_cast<int>(integer(operand)));
+
+        if (op == 'h' || op == 'L')
+            return lstat(operand.c_str(), &st) == 0 && S_ISLNK(st.st_mode);
+
+        if (op == 'r' || op == 'w' || op == 'x')
+            return access(operand.c_str(), op == 'r' ? R_OK : op == 'w' ? W_OK : X_OK) == 0;
+
+        if (stat(operand.c_str(), &st) != 0)
+            return false;
+
+        switch (op) {
+        case 'b':
+            return S_ISBLK(st.st_mode);
+        case 'c':
+            return S_ISCHR(st.st_mode);
+        case 'd':
+            return S_ISDIR(st.st_mode);
+        case 'f':
+            return S_ISREG(st.st_mode);
+        case 'g':
+            return st.st_mode & S_ISGID;
+        case 'p':
+            return S_ISFIFO(st.st_mode);
+        case 's':
+            return st.st_size > 0;
+        case 'S':
+            return S_ISSOCK(st.st_mode);
+        case 'u':
+            return st.st_mode & S_ISUID;
+        default: // e
+            return true;
+        }
+    }
+
+    bool evaluate_binary(std::string const& lhs, std::string const& op, std::string const& rhs) {
+        if (op == "=" || op == "==")
+            return lhs == rhs;
+        if (op == "!=")
+            return lhs != rhs;
+        if (op == "<")
+            return lhs < rhs;
+        if (op == ">")
+            return lhs > rhs;
+
+        if (op == "-nt" || op == "-ot" || op == "-ef") {
+            struct stat a, b;
+            auto has_a = stat(lhs.c_str(), &a) == 0, has_b = stat(rhs.c_str(), &b) == 0;
+
+            if (op == "-ef")
+                return has_a && has_b && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+
+            if (op == "-ot")
+                std::swap(a, b), std::swap(has_a, has_b);
+
+            return has_a && (!has_b || a.st_mtim.tv_sec > b.st_mtim.tv_sec
+                                 || (a.st_mtim.tv_sec == b.st_mtim.tv_sec
+                                     && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec));
+        }
+
+        auto l = integer(lhs), r = integer(rhs);
+
+        if (op == "-eq")
+            return l == r;
+        if (op == "-ne")
+            return l != r;
+        if (op == "-lt")
+            return l < r;
+        if (op == "-le")
+            return l <= r;
+        if (op == "-gt")
+            return l > r;
+
+        return l >= r;
+    }
+
+    bool primary() {
+        if (!more()) {
+            std::cerr << "test: argument expected\n";
+            error = true;
+            return false;
+        }
+
+        if (peek() == "(" && end - pos > 1) {
+            pos++;
+            auto value = expression();
+
+            if (!more() || peek() != ")") {
+                std::cerr << "test: ')' expected\n";
+                error = true;
+                return false;
+            }
+
+            pos++;
+            return value;
+        }
+
+        if (end - pos >= 3 && binary(peek(1))) {
+            auto const& lhs = args[pos];
+            auto const& op = args[pos + 1];
+            auto const& rhs = args[pos + 2];
+
+            pos += 3;
+            return evaluate_binary(lhs, op, rhs);
+        }
+
+        if (end - pos >= 2 && unary(peek())) {
+            auto op = peek()[1];
+            pos += 2;
+            return evaluate_unary(op, args[pos - 1]);
+        }
+
+        // A lone word is true if it is not empty.
+        return args[pos++].size();
+    }
+
+    bool negation() {
+        if (more() && peek() == "!" && end - pos > 1) {
+            pos++;
+            return !negation();
+        }
+
+        return primary();
+    }
+
+    bool conjunction() {
+        auto value = negation();
+
+        while (more() && peek() == "-a") {
+            pos++;
+            value = negation() && value;
+        }
+
+        return value;
+    }
+
+    bool expression() {
+        auto value = conjunction();
+
+        while (more() && peek() == "-o") {
+            pos++;
+            value = conjunction() || value;
+        }
+
+        return value;
+    }
+};
+
+int command$test(Args const& args) {
+    auto end = args.size();
+
+    if (args[0] == "[") {
+        if (args.size() < 2 || args.back() != "]") {
+            std::cerr << "[: missing ']'\n";
+            return 2;
+        }
+
+        end--;
+    }
+
+    auto parser = TestParser { args, 1, end, false };
+
+    if (!parser.more())
+        return 1;
+
+    auto value = parser.expression();
+
+    if (!parser.error && parser.more()) {
+        std::cerr << args[0] << ": " << parser.peek() << ": unexpected argument\n";
+        parser.error = true;
+    }
+
+    return parser.error ? 2 : !value;
+}
+
+int command$trace(Args const& args) {
+    // trace [on | off | clear | dump [file]], the dump is Chrome trace-event JSON.
+    auto const& cmd = args.size() > 1 ? args[1] : std::string {};
+
+    if (cmd.empty()) {
+        std::cout << "trace: " << (g_trace_enabled ? "on" : "off") << '\n';
+    } else if (cmd == "on" || cmd == "off") {
+        trace$enable(cmd == "on");
+    } else if (cmd == "clear") {
+        trace$clear();
+    } else if (cmd == "dump" && args.size() > 2) {
+        auto file = std::ofstream { args[2] };
+
+        if (!file) {
+            perror(args[2].c_str());
+            return 1;
+        }
+
+        trace$dump(file);
+    } else if (cmd == "dump") {
+        trace$dump(std::cout);
+    } else {
+        std::cerr << "trace: usage: trace [on | off | clear | dump [file]]\n";
+        return 2;
+    }
+
+    return 0;
+}
+
+int command$type(Args const& args) {
+    auto status = 0;
+
+    for (auto i = size_t { 1 }; i < args.size(); i++) {
+        if (auto const* alias = alias$find(args[i])) {
+            std::cout << args[i] << " is aliased to " << command$quote(alias->text) << '\n';
+        } else if (g_keywords.contains(args[i]) && !builtin$find(args[i])) {
+            std::cout << args[i] << " is a shell keyword\n";
+        } else if (function$find(args[i])) {
+            std::cout << args[i] << " is a function\n";
+        } else if (builtin$find(args[i])) {
+            std::cout << args[i] << " is a shell builtin\n";
+        } else if (auto const& path = hash$lookup(args[i]); path.size()) {
+            std::cout << args[i] << " is " << path << '\n';
+        } else {
+            std::cerr << "type: " << args[i] << ": not found\n";
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+// Every entry also has to be in g_keywords, so the tokenizer marks it as a Key.
+std::unordered_map<std::string, Builtin, StringHash, std::equal_to<>> const g_builtins = {
+    { "cd", command$cd },         { "pwd", command$pwd },       { "pushd", command$pushd },
+    { "popd", command$popd },     { "dirs", command$dirs },     { "export", command$export },
+    { "hash", command$hash },     { "jobs", command$jobs },     { "wait", command$wait },
+    { "fg", command$fg },         { "bg", command$bg },         { "true", command$true },
+    { "false", command$false },   { "echo", command$echo },     { "printf", command$printf },
+    { "test", command$test },     { "[", command$test },        { "type", command$type },
+    { "trace", command$trace },   { "unset", command$unset },   { "break", command$break },
+    { "continue", command$continue }, { "return", command$return }, { "alias", command$alias },
+    { "unalias", command$unalias }, { "exit", command$exit },
+};
+
+Builtin builtin$find(std::string_view name) {
+    auto it = g_builtins.find(name);
 
-    if (setenv(key.c_str(), val.c_str(), 1) < 0)
-        perror("setenv()");
+    return it != g_builtins.end() ? it->second : nullptr;
 }
 }
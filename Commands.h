@@ -1,8 +1,43 @@
 #pragma once
 
+#include <string>
+#include <string_view>
+#include <vector>
+
 #include "Parser.h"
 
 namespace BShell {
-void command$cd(std::shared_ptr<Expression> const&);
-void command$set_env(std::shared_ptr<Expression> const&);
-}
\ No newline at end of file
+// A builtin gets the whole argv, its name included, and returns its exit status.
+using Args = std::vector<std::string>;
+using Builtin = int (*)(Args const&);
+
+Builtin builtin$find(std::string_view);
+
+void command$set_env(Expression const&);
+
+int command$cd(Args const&);
+int command$pwd(Args const&);
+int command$pushd(Args const&);
+int command$popd(Args const&);
+int command$dirs(Args const&);
+int command$export(Args const&);
+int command$hash(Args const&);
+int command$jobs(Args const&);
+int command$wait(Args const&);
+int command$fg(Args const&);
+int command$bg(Args const&);
+int command$true(Args const&);
+int command$false(Args const&);
+int command$echo(Args const&);
+int command$printf(Args const&);
+int command$test(Args const&);
+int command$trace(Args const&);
+int command$type(Args const&);
+int command$unset(Args const&);
+int command$break(Args const&);
+int command$continue(Args const&);
+int command$return(Args const&);
+int command$exit(Args const&);
+int command$alias(Args const&);
+int command$unalias(Args const&);
+}
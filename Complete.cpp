@@ -0,0 +1,210 @@
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CommandTable.h"
+#include "Complete.h"
+#include "System.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+
+namespace BShell {
+// The listing of a directory is kept until the directory's mtime moves, so only the
+// first Tab in a directory pays for reading it. Dotfiles are kept apart, an empty
+// prefix never has to skip over them.
+struct DirListing {
+    timespec mtime;
+    std::shared_ptr<NameIndex const> visible, hidden;
+};
+
+std::unordered_map<std::string, DirListing, StringHash, std::equal_to<>> g_listings;
+
+// Every command on PATH and every keyword, rebuilt whenever hash$stamp() changes.
+std::shared_ptr<NameIndex const> g_commands;
+uint64_t g_commands_stamp = 0;
+
+void index$add(NameIndex& index, std::string_view name, bool dir) {
+    index.names.push_back(NameIndex::Name { static_cast<uint32_t>(index.pool.size()),
+                                            static_cast<uint32_t>(name.size()), dir });
+    index.pool += name;
+}
+
+void index$sort(NameIndex& index) {
+    std::sort(index.names.begin(), index.names.end(), [&](auto const& a, auto const& b) {
+        return std::string_view { index.pool.data() + a.offset, a.length }
+        < std::string_view { index.pool.data() + b.offset, b.length };
+    });
+}
+
+bool complete$scan(std::string const& dir, NameIndex& visible, NameIndex& hidden) {
+    auto fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    dir$scan(fd, [&](std::string_view name, unsigned char type) {
+        auto dir = type == DT_DIR;
+
+        // Only links and file systems without d_type need a stat.
+        if (type == DT_LNK || type == DT_UNKNOWN) {
+            struct stat st { };
+            dir = !fstatat(fd, std::string { name }.c_str(), &st, 0) && S_ISDIR(st.st_mode);
+        }
+
+        index$add(name[0] == '.' ? hidden : visible, name, dir);
+    });
+
+    close(fd);
+
+    index$sort(visible);
+    index$sort(hidden);
+
+    return true;
+}
+
+DirListing const* complete$listing(std::string const& dir) {
+    struct stat st { };
+
+    if (stat(dir.c_str(), &st) < 0 || !S_ISDIR(st.st_mode))
+        return nullptr;
+
+    auto& listing = g_listings[dir];
+
+    if (listing.visible && listing.mtime.tv_sec == st.st_mtim.tv_sec
+        && listing.mtime.tv_nsec == st.st_mtim.tv_nsec)
+        return &listing;
+
+    auto visible = std::make_shared<NameIndex>();
+    auto hidden = std::make_shared<NameIndex>();
+
+    if (!complete$scan(dir, *visible, *hidden)) {
+        g_listings.erase(dir);
+        return nullptr;
+    }
+
+    listing = DirListing { st.st_mtim, std::move(visible), std::move(hidden) };
+
+    return &listing;
+}
+
+std::shared_ptr<NameIndex const> complete$commands() {
+    auto stamp = hash$stamp();
+
+    if (g_commands && stamp == g_commands_stamp)
+        return g_commands;
+
+    auto index = std::make_shared<NameIndex>();
+
+    for (auto const& keyword : g_keywords)
+        index$add(*index, keyword, false);
+
+    for (auto const& dir : hash$dirs()) {
+        auto const* listing = complete$listing(dir);
+
+        if (!listing)
+            continue;
+
+        for (auto i = size_t {}; i < listing->visible->names.size(); i++)
+            if (!listing->visible->names[i].dir)
+                index$add(*index, listing->visible->name(i), false);
+    }
+
+    index$sort(*index);
+
+    // The same command in several PATH directories is offered once.
+    auto& names = index->names;
+    names.erase(std::unique(names.begin(), names.end(),
+                            [&](auto const& a, auto const& b) {
+                                return std::string_view { index->pool.data() + a.offset, a.length }
+                                == std::string_view { index->pool.data() + b.offset, b.length };
+                            }),
+                names.end());
+
+    g_commands_stamp = stamp;
+    g_commands = std::move(index);
+
+    return g_commands;
+}
+
+std::string Completion::candidate(size_t i) const {
+    auto const& name = index->names[i];
+
+    return base + std::string { index->name(i) } + (name.dir ? "/" : "");
+}
+
+std::string Completion::common() const {
+    // The candidates are sorted, what the first and last share every one shares.
+    auto a = index->name(first), b = index->name(last - 1);
+    auto length = std::mismatch(a.begin(), a.end(), b.begin(), b.end()).first - a.begin();
+
+    return base + std::string { a.substr(0, length) };
+}
+
+Completion complete$word(std::string_view line, size_t cursor) {
+    // Completes the word that ends at the cursor: a command name in command position,
+    // a path anywhere else or as soon as the word contains a slash. Apart from reading
+    // a directory the first time, a Tab costs a stat and two binary searches.
+    TRACE_SCOPE("complete");
+
+    auto start = cursor;
+
+    while (start && !strchr(" |;&<>", line[start - 1]))
+        start--;
+
+    auto word = line.substr(start, cursor - start);
+    auto before = line.substr(0, start).find_last_not_of(' ');
+    auto completion = Completion { start, cursor, {}, nullptr, 0, 0, false };
+    auto slash = word.rfind('/');
+
+    if (slash == std::string_view::npos
+        && (before == std::string_view::npos || strchr("|;&", line[before]))) {
+        completion.command = true;
+        completion.index = complete$commands();
+    } else {
+        auto dir = std::string {};
+
+        if (slash != std::string_view::npos) {
+            completion.base = word.substr(0, slash + 1);
+            dir = completion.base;
+            word.remove_prefix(slash + 1);
+        }
+
+        if (dir.starts_with("~/"))
+            dir = get$home() + dir.substr(1);
+        else if (!dir.starts_with('/'))
+            dir = get$cwd() + '/' + dir;
+
+        auto const* listing = complete$listing(dir);
+
+        if (!listing)
+            return completion;
+
+        completion.index = word.starts_with('.') ? listing->hidden : listing->visible;
+    }
+
+    auto const& index = *completion.index;
+    auto prefix = [&](NameIndex::Name const& name) {
+        return std::string_view { index.pool.data() + name.offset, name.length }.substr(
+            0, word.size());
+    };
+
+    auto first = std::partition_point(index.names.begin(), index.names.end(),
+                                      [&](auto const& name) { return prefix(name) < word; });
+    auto last = std::partition_point(first, index.names.end(),
+                                     [&](auto const& name) { return prefix(name) == word; });
+
+    completion.first = first - index.names.begin();
+    completion.last = last - index.names.begin();
+
+    return completion;
+}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace BShell {
+// Sorted names of a directory (or of every command), searched by prefix.
+struct NameIndex {
+    struct Name {
+        uint32_t offset, length; // within pool
+        bool dir;
+    };
+
+    std::string pool;
+    std::vector<Name> names;
+
+    std::string_view name(size_t i) const { return { pool.data() + names[i].offset, names[i].length }; }
+};
+
+// The candidates for the word before the cursor, a range of one index so that no
+// candidate is copied until it is used.
+struct Completion {
+    size_t start, end;   // the word being completed, within the line
+    std::string base;    // typed text every candidate starts with, e.g. the directory part
+    std::shared_ptr<NameIndex const> index;
+    size_t first, last;  // candidates within index
+    bool command;
+
+    size_t size() const { return last - first; }
+    std::string candidate(size_t) const;
+    std::string common() const;
+};
+
+Completion complete$word(std::string_view, size_t);
+}
@@ -0,0 +1,86 @@
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Functions.h"
+#include "Parser.h"
+#include "Tokenizer.h"
+
+namespace BShell {
+std::unordered_map<std::string, std::shared_ptr<ShellFunction const>, StringHash, std::equal_to<>>
+    g_functions;
+std::unordered_map<std::string, Alias, StringHash, std::equal_to<>> g_aliases;
+
+void function$define(std::string_view name, Expression const& body) {
+    // The Ast of a statement is gone once it ran, the function gets a copy of it.
+    g_functions.insert_or_assign(std::string { name },
+                                 std::make_shared<ShellFunction const>(
+                                     ShellFunction { body.ast(), body.index() }));
+}
+
+std::shared_ptr<ShellFunction const> function$find(std::string_view name) {
+    auto it = g_functions.find(name);
+
+    return it != g_functions.end() ? it->second : nullptr;
+}
+
+bool function$unset(std::string_view name) {
+    auto it = g_functions.find(name);
+
+    if (it == g_functions.end())
+        return false;
+
+    g_functions.erase(it);
+    return true;
+}
+
+std::vector<std::string_view> function$names() {
+    auto names = std::vector<std::string_view> {};
+
+    for (auto const& [name, function] : g_functions)
+        names.push_back(name);
+
+    return names;
+}
+
+void alias$define(std::string_view name, std::string_view value) {
+    // Aliases are not expanded within an alias, so `alias ls='ls -F'` does not recurse.
+    auto alias = Alias { std::string { value }, {}, false };
+    auto tokenizer = Tokenizer { alias.text, false, false };
+    auto spans = tokenizer.spans();
+
+    alias.spans.assign(spans.begin(), spans.end());
+    alias.leads = tokenizer.expects_command();
+
+    g_aliases.insert_or_assign(std::string { name }, std::move(alias));
+}
+
+Alias const* alias$find(std::string_view name) {
+    auto it = g_aliases.find(name);
+
+    return it != g_aliases.end() ? &it->second : nullptr;
+}
+
+bool alias$remove(std::string_view name) {
+    auto it = g_aliases.find(name);
+
+    if (it == g_aliases.end())
+        return false;
+
+    g_aliases.erase(it);
+    return true;
+}
+
+void alias$clear() { g_aliases.clear(); }
+
+std::vector<std::string_view> alias$names() {
+    auto names = std::vector<std::string_view> {};
+
+    for (auto const& [name, alias] : g_aliases)
+        names.push_back(name);
+
+    return names;
+}
+}
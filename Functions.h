@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Parser.h"
+#include "Tokenizer.h"
+
+namespace BShell {
+// A function keeps a copy of the Ast it was defined in, a call runs the body from it
+// without parsing anything again.
+struct ShellFunction {
+    Ast ast;
+    uint32_t body;
+};
+
+// An alias is tokenized once when it is defined, the tokenizer splices its tokens in
+// place of the word. Offsets of the spans are within text.
+struct Alias {
+    std::string text;
+    std::vector<TokenSpan> spans;
+    bool leads; // a command follows, like after `alias t=time`
+};
+
+// Shared, so a function that redefines itself keeps running the body it started with.
+void function$define(std::string_view, Expression const&);
+std::shared_ptr<ShellFunction const> function$find(std::string_view);
+bool function$unset(std::string_view);
+std::vector<std::string_view> function$names();
+
+void alias$define(std::string_view, std::string_view);
+Alias const* alias$find(std::string_view);
+bool alias$remove(std::string_view);
+void alias$clear();
+std::vector<std::string_view> alias$names();
+}
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Glob.h"
+#include "System.h"
+#include "Trace.h"
+
+namespace BShell {
+// The entries of one directory, read in a single pass before any of them is used.
+struct Glob::Entry {
+    uint32_t offset, length;
+    unsigned char type;
+};
+
+bool glob$magic(std::string_view pattern) {
+    for (auto i = size_t {}; i < pattern.size(); i++) {
+        if (pattern[i] == '\\')
+            i++;
+        else if (pattern[i] == '*' || pattern[i] == '?' || pattern[i] == '[')
+            return true;
+    }
+
+    return false;
+}
+
+std::string glob$escape(std::string_view text, std::string_view special) {
+    // The backslash itself is always escaped, the shell has no escapes of its own.
+    auto pattern = std::string {};
+
+    for (auto c : text) {
+        if (c == '\\' || special.find(c) != std::string_view::npos)
+            pattern += '\\';
+
+        pattern += c;
+    }
+
+    return pattern;
+}
+
+std::string glob$literal(std::string_view pattern) {
+    auto literal = std::string {};
+
+    for (auto i = size_t {}; i < pattern.size(); i++) {
+        if (pattern[i] == '\\' && i + 1 < pattern.size())
+            i++;
+
+        literal += pattern[i];
+    }
+
+    return literal;
+}
+
+size_t glob$set(std::string_view pattern, size_t i, std::bitset<256>& set) {
+    // Parses the bracket expression starting at pattern[i], returns the index of its
+    // closing bracket or 0 when there is none and the '[' is literal.
+    auto negate = i + 1 < pattern.size() && (pattern[i + 1] == '!' || pattern[i + 1] == '^');
+    auto first = true;
+
+    for (auto j = i + 1 + negate; j < pattern.size(); j++, first = false) {
+        auto lo = static_cast<unsigned char>(pattern[j]);
+
+        if (lo == ']' && !first) {
+            if (negate)
+                set.flip();
+
+            return j;
+        }
+
+        if (lo == '[' && j + 1 < pattern.size() && pattern[j + 1] == ':') {
+            auto end = pattern.find(":]", j + 2);
+
+            if (end != std::string_view::npos) {
+                auto name = pattern.substr(j + 2, end - j - 2);
+                auto test = name == "alpha" ? isalpha
+                    : name == "digit"       ? isdigit
+                    : name == "alnum"       ? isalnum
+                    : name == "upper"       ? isupper
+                    : name == "lower"       ? islower
+                    : name == "space"       ? isspace
+                    : name == "punct"       ? ispunct
+                    : name == "xdigit"      ? isxdigit
+                                            : nullptr;
+
+                for (auto c = 0; test && c < 128; c++)
+                    set[c] = set[c] || test(c);
+
+                j = end + 1;
+                continue;
+            }
+        }
+
+        if (lo == '\\' && j + 1 < pattern.size())
+            lo = pattern[++j];
+
+        auto hi = lo;
+
+        if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+            j += 2;
+
+            if (pattern[j] == '\\' && j + 1 < pattern.size())
+                j++;
+
+            hi = pattern[j];
+        }
+
+        for (auto c = unsigned { lo }; c <= hi; c++)
+            set[c] = true;
+    }
+
+    return 0;
+}
+
+Glob::Glob(std::string_view pattern)
+    : m_absolute(pattern.starts_with('/'))
+    , m_dirs(pattern.ends_with('/')) {
+    while (pattern.size()) {
+        auto slash = pattern.find('/');
+        auto component = pattern.substr(0, slash);
+
+        pattern.remove_prefix(slash == std::string_view::npos ? pattern.size() : slash + 1);
+
+        if (component.empty())
+            continue;
+
+        // `**` already spans any number of directories, a second one adds nothing.
+        if (component == "**" && m_segments.size() && m_segments.back().kind == Segment::Recurse)
+            continue;
+
+        compile(component, m_segments.emplace_back());
+    }
+
+    // A trailing `**` is every file and directory below, as if it were `**/*`.
+    if (m_segments.size() && m_segments.back().kind == Segment::Recurse)
+        compile("*", m_segments.emplace_back());
+}
+
+void Glob::compile(std::string_view component, Segment& segment) {
+    segment.kind = component == "**" ? Segment::Recurse : Segment::Literal;
+    segment.dot = component.starts_with('.') || component.starts_with("\\.");
+
+    if (segment.kind == Segment::Recurse)
+        return;
+
+    auto literal = [&](unsigned char c) {
+        if (segment.ops.empty())
+            segment.prefix += c;
+        else
+            segment.ops.push_back(Op { Op::Char, c, 0 });
+    };
+
+    for (auto i = size_t {}; i < component.size(); i++) {
+        auto c = component[i];
+        auto set = std::bitset<256> {};
+
+        if (c == '\\' && i + 1 < component.size()) {
+            literal(component[++i]);
+        } else if (c == '*') {
+            if (segment.ops.empty() || segment.ops.back().kind != Op::Star)
+                segment.ops.push_back(Op { Op::Star, 0, 0 });
+        } else if (c == '?') {
+            segment.ops.push_back(Op { Op::Any, 0, 0 });
+        } else if (auto end = c == '[' ? glob$set(component, i, set) : 0) {
+            segment.ops.push_back(Op { Op::Set, 0, static_cast<uint16_t>(m_sets.size()) });
+            m_sets.push_back(set);
+            i = end;
+        } else {
+            literal(c);
+        }
+    }
+
+    if (segment.ops.size())
+        segment.kind = Segment::Pattern;
+}
+
+bool Glob::match(Segment const& segment, std::string_view name) const {
+    // Leading dots are only matched explicitly, and the literal prefix rejects most
+    // names before any pattern operation runs.
+    if ((name[0] == '.' && !segment.dot) || !name.starts_with(segment.prefix))
+        return false;
+
+    name.remove_prefix(segment.prefix.size());
+
+    // A star only ever has to be retried from the last one seen, the component has no
+    // slashes for an earlier one to span.
+    auto const& ops = segment.ops;
+    auto p = size_t {}, n = size_t {};
+    auto star = std::string_view::npos, resume = size_t {};
+
+    while (n < name.size()) {
+        if (p < ops.size()) {
+            auto const& op = ops[p];
+            auto c = static_cast<unsigned char>(name[n]);
+
+            if (op.kind == Op::Star) {
+                star = ++p;
+                resume = n;
+                continue;
+            }
+
+            if (op.kind == Op::Any || (op.kind == Op::Char && op.c == c)
+                || (op.kind == Op::Set && m_sets[op.set][c])) {
+                p++;
+                n++;
+                continue;
+            }
+        }
+
+        if (star == std::string_view::npos)
+            return false;
+
+        p = star;
+        n = ++resume;
+    }
+
+    while (p < ops.size() && ops[p].kind == Op::Star)
+        p++;
+
+    return p == ops.size();
+}
+
+bool glob$match(std::string_view pattern, std::string_view text) {
+    // The whole pattern is compiled as one component, `**` is just two stars.
+    auto glob = Glob { "" };
+    auto& segment = glob.m_segments.emplace_back();
+
+    glob.compile(pattern == "**" ? "*" : pattern, segment);
+    segment.dot = true;
+
+    if (text.empty())
+        return segment.prefix.empty()
+            && std::all_of(segment.ops.begin(), segment.ops.end(),
+                           [](Glob::Op const& op) { return op.kind == Glob::Op::Star; });
+
+    return glob.match(segment, text);
+}
+
+bool glob$dir(int dirfd, char const* name, unsigned char type) {
+    struct stat st { };
+
+    if (type == DT_DIR)
+        return true;
+
+    // Links and file systems without d_type take a stat, nothing else does.
+    return (type == DT_LNK || type == DT_UNKNOWN) && !fstatat(dirfd, name, &st, 0)
+        && S_ISDIR(st.st_mode);
+}
+
+bool Glob::add(int dirfd, std::string& path, std::string_view name, unsigned char type,
+               size_t i, std::vector<std::string>& paths, size_t limit) const {
+    // The entry name of the directory matched segment i, the rest of the pattern
+    // continues inside it. Returns false once there are too many matches.
+    auto const c_name = std::string { name };
+
+    if (i + 1 == m_segments.size()) {
+        struct stat st { };
+
+        // A literal last component was not read from the directory, it may not exist.
+        if (m_segments[i].kind == Segment::Literal
+            && fstatat(dirfd, c_name.c_str(), &st, AT_SYMLINK_NOFOLLOW) < 0)
+            return true;
+
+        if (m_dirs && !glob$dir(dirfd, c_name.c_str(), type))
+            return true;
+
+        if (paths.size() >= limit)
+            return false;
+
+        paths.push_back(path + c_name + (m_dirs ? "/" : ""));
+        return true;
+    }
+
+    if (m_segments[i].kind != Segment::Literal && !glob$dir(dirfd, c_name.c_str(), type))
+        return true;
+
+    auto fd = openat(dirfd, c_name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return true;
+
+    auto size = path.size();
+
+    path += name;
+    path += '/';
+
+    auto ok = walk(fd, path, i + 1, paths, limit);
+
+    path.resize(size);
+    close(fd);
+
+    return ok;
+}
+
+bool Glob::walk(int dirfd, std::string& path, size_t i, std::vector<std::string>& paths,
+                size_t limit) const {
+    auto const& segment = m_segments[i];
+
+    if (segment.kind == Segment::Literal)
+        return add(dirfd, path, segment.prefix, DT_UNKNOWN, i, paths, limit);
+
+    // Every directory is read once, even under `**` where its entries are matched
+    // against the next component and its subdirectories are descended into.
+    auto pool = std::string {};
+    auto entries = std::vector<Entry> {};
+
+    dir$scan(dirfd, [&](std::string_view name, unsigned char type) {
+        entries.push_back(Entry { static_cast<uint32_t>(pool.size()),
+                                  static_cast<uint32_t>(name.size()), type });
+        pool += name;
+    });
+
+    auto recurse = segment.kind == Segment::Recurse;
+    auto const& next = m_segments[i + recurse];
+
+    for (auto const& entry : entries) {
+        auto name = std::string_view { pool }.substr(entry.offset, entry.length);
+
+        if (match(next, name) && !add(dirfd, path, name, entry.type, i + recurse, paths, limit))
+            return false;
+
+        // Symlinked directories are not followed, they could lead back up the tree.
+        if (recurse && name[0] != '.') {
+            struct stat st { };
+            auto c_name = std::string { name };
+            auto dir = entry.type == DT_DIR
+                || (entry.type == DT_UNKNOWN
+                    && !fstatat(dirfd, c_name.c_str(), &st, AT_SYMLINK_NOFOLLOW)
+                    && S_ISDIR(st.st_mode));
+
+            if (!dir)
+                continue;
+
+            auto fd = openat(dirfd, c_name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+            if (fd < 0)
+                continue;
+
+            auto size = path.size();
+
+            path += name;
+            path += '/';
+
+            auto ok = walk(fd, path, i, paths, limit);
+
+            path.resize(size);
+            close(fd);
+
+            if (!ok)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool Glob::expand(std::vector<std::string>& paths, size_t limit) const {
+    TRACE_SCOPE("glob");
+
+    if (m_segments.empty())
+        return true;
+
+    auto fd = open(m_absolute ? "/" : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (fd < 0)
+        return true;
+
+    auto path = std::string { m_absolute ? "/" : "" };
+    auto before = paths.size();
+    auto ok = walk(fd, path, 0, paths, limit + before);
+
+    close(fd);
+
+    // std::string compares bytes as unsigned, the order does not depend on the locale.
+    std::sort(paths.begin() + before, paths.end());
+
+    return ok;
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace BShell {
+// More matches than this fail the expansion instead of building a huge argv.
+constexpr size_t g_glob_limit = size_t { 1 } << 20;
+
+// A pathname pattern compiled once into one matcher per path component. A backslash
+// makes the next character literal, which is how quoted parts of a word are kept out
+// of the pattern.
+class Glob {
+public:
+    explicit Glob(std::string_view);
+
+    // Appends the matching paths sorted bytewise, returns false when there are more
+    // than the limit.
+    bool expand(std::vector<std::string>&, size_t = g_glob_limit) const;
+
+private:
+    friend bool glob$match(std::string_view, std::string_view);
+
+    struct Op {
+        enum Kind : uint8_t { Char, Any, Star, Set } kind;
+        unsigned char c;
+        uint16_t set; // index into m_sets
+    };
+
+    struct Segment {
+        enum Kind : uint8_t { Literal, Pattern, Recurse } kind;
+        std::string prefix; // the whole component when Literal
+        std::vector<Op> ops; // what follows the prefix
+        bool dot;            // matches names starting with a dot
+    };
+
+    struct Entry;
+
+    void compile(std::string_view, Segment&);
+    bool match(Segment const&, std::string_view) const;
+    bool walk(int, std::string&, size_t, std::vector<std::string>&, size_t) const;
+    bool add(int, std::string&, std::string_view, unsigned char, size_t,
+             std::vector<std::string>&, size_t) const;
+
+    std::vector<Segment> m_segments;
+    std::vector<std::bitset<256>> m_sets;
+    bool m_absolute = false;
+    bool m_dirs = false; // a trailing slash only matches directories
+};
+
+bool glob$magic(std::string_view);
+std::string glob$escape(std::string_view, std::string_view = "*?[");
+std::string glob$literal(std::string_view);
+// Matches a whole string the way case does, '/' and leading dots are not special.
+bool glob$match(std::string_view, std::string_view);
+}
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Highlight.h"
+#include "Render.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+
+namespace BShell {
+constexpr auto g_token_colors = [] {
+    // TokenType is a bit flag, so its bit width is a dense index.
+    auto colors = std::array<Color, 17> {};
+
+    auto set = [&](TokenType type, Color color) { colors[std::bit_width<uint16_t>(type)] = color; };
+
+    set(Executable, Blue);
+    set(Key, Blue);
+    set(Function, Blue);
+    set(Background, Red);
+    set(Sequential, Red);
+    set(SequentialIf, Green);
+    set(RedirectPipe, Green);
+    set(RedirectOut, Green);
+    set(RedirectIn, Green);
+    set(Eval, Cyan);
+
+    return colors;
+}();
+
+std::string_view Highlighter::colors(std::string_view input) {
+    TRACE_SCOPE("highlight");
+
+    auto prefix = static_cast<size_t>(
+        std::mismatch(input.begin(), input.end(), m_input.begin(), m_input.end()).first
+        - input.begin());
+
+    if (prefix == input.size() && prefix == m_input.size())
+        return m_colors;
+
+    // The unchanged tail of the line, it may not overlap the unchanged head.
+    auto limit = std::min(input.size(), m_input.size()) - prefix;
+    auto suffix = static_cast<size_t>(
+        std::mismatch(input.rbegin(), input.rbegin() + limit, m_input.rbegin()).first
+        - input.rbegin());
+    auto delta = static_cast<int64_t>(input.size()) - static_cast<int64_t>(m_input.size());
+
+    // Tokens before the last checkpoint before the edit cannot have changed. A checkpoint
+    // right at the edit does not count, the token before it peeked at the edited byte.
+    auto keep = std::upper_bound(m_checkpoints.begin() + 1, m_checkpoints.end(),
+                                 std::max<size_t>(prefix, 1) - 1,
+                                 [](size_t offset, Checkpoint const& checkpoint) {
+                                     return offset < checkpoint.offset;
+                                 });
+    auto checkpoint = *(keep - 1);
+    auto resync = m_checkpoints.end();
+
+    // Once lexing reaches the unchanged tail in the same state as the old line did,
+    // the rest of the old tokens are still valid and only have to be moved.
+    auto tokenizer = Tokenizer(input, checkpoint, [&](Checkpoint const& next) {
+        if (next.offset < input.size() - suffix)
+            return false;
+
+        auto old = std::lower_bound(keep, m_checkpoints.end(), next.offset - delta,
+                                    [](Checkpoint const& checkpoint, int64_t offset) {
+                                        return checkpoint.offset < offset;
+                                    });
+
+        if (old == m_checkpoints.end() || old->offset != next.offset - delta
+            || !old->same_state(next))
+            return false;
+
+        resync = old;
+
+        return true;
+    });
+
+    auto spans = tokenizer.spans();
+    auto end = resync != m_checkpoints.end() ? resync->offset : m_input.size();
+    auto spans_end = resync != m_checkpoints.end() ? resync->spans : m_spans.size();
+    auto spans_delta
+        = static_cast<int64_t>(spans.size()) - static_cast<int64_t>(spans_end - checkpoint.spans);
+
+    // Shift the reused tail before splicing the re-lexed tokens in front of it.
+    for (auto it = resync; it != m_checkpoints.end(); it++) {
+        it->offset += delta;
+        it->spans += spans_delta;
+    }
+
+    for (auto i = spans_end; i < m_spans.size(); i++)
+        m_spans[i].offset += delta;
+
+    auto fresh = std::vector<Checkpoint> {};
+
+    for (auto next : tokenizer.checkpoints()) {
+        if (next.offset <= checkpoint.offset)
+            continue;
+
+        next.spans += checkpoint.spans;
+        fresh.push_back(next);
+    }
+
+    m_checkpoints.insert(m_checkpoints.erase(keep, resync), fresh.begin(), fresh.end());
+    m_spans.insert(m_spans.erase(m_spans.begin() + checkpoint.spans, m_spans.begin() + spans_end),
+                   spans.begin(), spans.end());
+
+    auto colors = std::string(end + delta - checkpoint.offset, Default);
+
+    for (auto const& span : spans)
+        std::fill_n(colors.begin() + (span.offset - checkpoint.offset), span.length,
+                    g_token_colors[std::bit_width<uint16_t>(span.type)]);
+
+    m_colors.replace(checkpoint.offset, end - checkpoint.offset, colors);
+    m_input = input;
+
+    return m_colors;
+}
+}
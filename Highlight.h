@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Tokenizer.h"
+
+namespace BShell {
+// Keeps the token stream of the line being edited, and only re-lexes from the last
+// token boundary before the first changed byte.
+class Highlighter {
+public:
+    std::string_view colors(std::string_view);
+
+private:
+    std::string m_input, m_colors;
+    std::vector<TokenSpan> m_spans;
+    // Always starts with the checkpoint at the beginning of the line.
+    std::vector<Checkpoint> m_checkpoints { Checkpoint {} };
+};
+}
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "History.h"
+#include "System.h"
+#include "Trace.h"
+#include "Variables.h"
+
+namespace BShell {
+// Entries are addressed by age, 0 being the newest. The entries of this session come
+// first, followed by the history file as it was mapped, which is split into entries
+// lazily from its end so that startup does not depend on its size.
+int g_history_fd = -1;
+char const* g_history_map = nullptr;
+size_t g_history_mapped = 0;
+size_t g_history_scanned = 0; // the map before this offset has not been split yet
+std::vector<size_t> g_history_lines; // start of each mapped entry, newest first
+std::vector<std::string> g_history_session;
+
+// Entries added since the file was last mapped; once the window is full the file is
+// mapped again and they are only kept on disk.
+constexpr auto g_history_window = size_t { 1000 };
+
+// Mapped entries containing each trigram, hashed into a fixed number of buckets. A posting
+// list holds increasing entry indices plus one, delta and varint encoded.
+struct Postings {
+    std::string bytes;
+    size_t last;
+};
+
+constexpr auto g_history_buckets = size_t { 1 } << 16;
+std::vector<Postings> g_history_grams;
+size_t g_history_indexed = 0; // mapped entries added to g_history_grams
+
+std::string history$path() {
+    if (auto* path = var$get("HISTFILE"); path && *path)
+        return path;
+
+    return get$home() + "/.bshell_history";
+}
+
+void history$map() {
+    if (g_history_map)
+        munmap(const_cast<char*>(g_history_map), g_history_mapped);
+
+    g_history_map = nullptr;
+    g_history_mapped = g_history_scanned = g_history_indexed = 0;
+    g_history_lines.clear();
+    g_history_grams.clear();
+
+    auto st = (struct stat) {};
+
+    if (fstat(g_history_fd, &st) < 0 || !st.st_size)
+        return;
+
+    auto* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, g_history_fd, 0);
+
+    if (map == MAP_FAILED) {
+        perror("mmap()");
+        return;
+    }
+
+    g_history_map = static_cast<char const*>(map);
+    g_history_mapped = g_history_scanned = st.st_size;
+}
+
+void history$open() {
+    g_history_fd = open(history$path().c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+
+    // Without a history file the history of this session is all there is.
+    if (g_history_fd < 0)
+        return;
+
+    history$map();
+}
+
+void history$add(std::string const& line) {
+    TRACE_SCOPE("history");
+
+    g_history_session.push_back(line);
+
+    if (g_history_fd < 0)
+        return;
+
+    // O_APPEND keeps concurrent sessions from overwriting each other, the lock keeps
+    // a long entry from being interleaved with another one.
+    auto entry = line + '\n';
+
+    flock(g_history_fd, LOCK_EX);
+
+    for (auto* buf = entry.data(), *end = buf + entry.size(); buf < end;) {
+        auto count = write(g_history_fd, buf, end - buf);
+
+        if (count < 0) {
+            perror("write()");
+            break;
+        }
+
+        buf += count;
+    }
+
+    flock(g_history_fd, LOCK_UN);
+
+    if (g_history_session.size() >= g_history_window) {
+        g_history_session.clear();
+        history$map();
+    }
+}
+
+std::optional<std::string_view> history$mapped(size_t index) {
+    // Split entries off the end of the unscanned part of the map until index exists.
+    while (g_history_lines.size() <= index && g_history_scanned) {
+        auto end = g_history_scanned;
+
+        if (g_history_map[end - 1] == '\n')
+            end--;
+
+        auto* newline = static_cast<char const*>(memrchr(g_history_map, '\n', end));
+        auto start = newline ? size_t(newline - g_history_map) + 1 : 0;
+
+        if (start < end)
+            g_history_lines.push_back(start);
+
+        g_history_scanned = start;
+    }
+
+    if (index >= g_history_lines.size())
+        return std::nullopt;
+
+    auto start = g_history_lines[index];
+    auto end = index ? g_history_lines[index - 1] : g_history_mapped;
+
+    if (g_history_map[end - 1] == '\n')
+        end--;
+
+    return std::string_view { g_history_map + start, end - start };
+}
+
+std::optional<std::string_view> history$at(size_t age) {
+    if (age < g_history_session.size())
+        return *(g_history_session.rbegin() + age);
+
+    return history$mapped(age - g_history_session.size());
+}
+
+size_t history$bucket(std::string_view gram) {
+    auto hash = (uint32_t(uint8_t(gram[0])) << 16) | (uint32_t(uint8_t(gram[1])) << 8)
+                | uint8_t(gram[2]);
+
+    return (hash * 2654435761u) >> 16;
+}
+
+void history$index() {
+    if (g_history_grams.empty())
+        g_history_grams.resize(g_history_buckets);
+
+    for (; auto entry = history$mapped(g_history_indexed); g_history_indexed++) {
+        auto id = g_history_indexed + 1;
+
+        for (auto i = size_t {}; i + 3 <= entry->size(); i++) {
+            auto& postings = g_history_grams[history$bucket(entry->substr(i, 3))];
+
+            if (postings.last == id)
+                continue;
+
+            for (auto delta = id - postings.last; true; delta >>= 7) {
+                if (delta < 0x80) {
+                    postings.bytes += char(delta);
+                    break;
+                }
+
+                postings.bytes += char(0x80 | (delta & 0x7F));
+            }
+
+            postings.last = id;
+        }
+    }
+}
+
+// Walks one posting list in increasing order.
+struct PostingCursor {
+    std::string_view bytes;
+    size_t value;
+
+    bool advance() {
+        if (bytes.empty())
+            return false;
+
+        auto delta = size_t {};
+
+        for (auto shift = 0; bytes.size(); shift += 7) {
+            auto byte = uint8_t(bytes[0]);
+            bytes.remove_prefix(1);
+            delta |= size_t(byte & 0x7F) << shift;
+
+            if (!(byte & 0x80))
+                break;
+        }
+
+        value += delta;
+
+        return true;
+    }
+};
+
+std::optional<size_t> history$search_mapped(std::string_view needle, size_t from) {
+    if (needle.size() < 3) {
+        for (auto index = from; auto entry = history$mapped(index); index++) {
+            if (entry->find(needle) != std::string_view::npos)
+                return index;
+        }
+
+        return std::nullopt;
+    }
+
+    history$index();
+
+    // Candidates have every trigram of the needle, they are intersected in lockstep
+    // and only the survivors are compared against the needle.
+    auto cursors = std::vector<PostingCursor> {};
+
+    for (auto i = size_t {}; i + 3 <= needle.size(); i++) {
+        auto& postings = g_history_grams[history$bucket(needle.substr(i, 3))];
+        auto cursor = PostingCursor { postings.bytes, 0 };
+
+        if (std::none_of(cursors.begin(), cursors.end(),
+                         [&](auto const& other) { return other.bytes.data() == cursor.bytes.data(); }))
+            cursors.push_back(cursor);
+    }
+
+    auto target = from + 1;
+
+    while (true) {
+        auto agreed = true;
+
+        for (auto& cursor : cursors) {
+            while (cursor.value < target) {
+                if (!cursor.advance())
+                    return std::nullopt;
+            }
+
+            if (cursor.value > target) {
+                target = cursor.value;
+                agreed = false;
+            }
+        }
+
+        if (!agreed)
+            continue;
+
+        if (history$mapped(target - 1)->find(needle) != std::string_view::npos)
+            return target - 1;
+
+        target++;
+    }
+}
+
+std::optional<size_t> history$search(std::string_view needle, size_t from) {
+    // The age of the newest entry at least from entries old containing needle.
+    for (auto age = from; age < g_history_session.size(); age++) {
+        if (history$at(age)->find(needle) != std::string_view::npos)
+            return age;
+    }
+
+    auto session = g_history_session.size();
+    auto found = history$search_mapped(needle, std::max(from, session) - session);
+
+    if (!found)
+        return std::nullopt;
+
+    return *found + session;
+}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace BShell {
+void history$open();
+void history$add(std::string const&);
+std::optional<std::string_view> history$at(size_t);
+std::optional<size_t> history$search(std::string_view, size_t);
+}
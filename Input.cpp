@@ -0,0 +1,187 @@
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "Input.h"
+
+namespace BShell {
+// Bytes read from the terminal but not decoded yet are g_buffer[g_begin, g_end).
+char g_buffer[4096];
+size_t g_begin = 0, g_end = 0;
+std::string g_paste;
+
+constexpr auto g_paste_begin = std::string_view { "\x1b[200~" };
+constexpr auto g_paste_end = std::string_view { "\x1b[201~" };
+
+// How long a lone ESC waits for the rest of a sequence.
+constexpr auto g_escape_timeout = 25;
+
+bool input$fill(int timeout = -1) {
+    // Keep undecoded bytes, a sequence may be split across reads.
+    if (g_begin) {
+        memmove(g_buffer, g_buffer + g_begin, g_end - g_begin);
+        g_end -= g_begin;
+        g_begin = 0;
+    }
+
+    if (g_end == sizeof(g_buffer))
+        return false;
+
+    if (timeout >= 0) {
+        auto fd = pollfd { STDIN_FILENO, POLLIN, 0 };
+
+        if (poll(&fd, 1, timeout) <= 0)
+            return false;
+    }
+
+    while (true) {
+        auto count = read(STDIN_FILENO, g_buffer + g_end, sizeof(g_buffer) - g_end);
+
+        if (count < 0 && errno == EINTR)
+            continue;
+
+        if (count < 0) {
+            perror("read()");
+            exit(1);
+        }
+
+        g_end += count;
+
+        return count > 0;
+    }
+}
+
+bool input$pending() { return g_begin < g_end; }
+
+std::string_view input$buffered() { return { g_buffer + g_begin, g_end - g_begin }; }
+
+KeyEvent input$take(KeyCode code, size_t length) {
+    auto text = input$buffered().substr(0, length);
+    g_begin += length;
+
+    return KeyEvent { code, text };
+}
+
+KeyEvent input$paste() {
+    // A paste can be much larger than the buffer, it is collected until the end marker.
+    g_begin += g_paste_begin.size();
+    g_paste.clear();
+
+    while (true) {
+        auto buffered = input$buffered();
+        auto end = buffered.find(g_paste_end);
+
+        if (end != std::string_view::npos) {
+            g_paste.append(buffered.substr(0, end));
+            g_begin += end + g_paste_end.size();
+
+            return KeyEvent { KeyCode::Paste, g_paste };
+        }
+
+        // Hold back what could be the start of a split end marker.
+        auto keep = buffered.size() < g_paste_end.size() ? buffered.size() : g_paste_end.size() - 1;
+        g_paste.append(buffered.substr(0, buffered.size() - keep));
+        g_begin += buffered.size() - keep;
+
+        if (!input$fill()) {
+            g_paste.append(input$buffered());
+            g_begin = g_end;
+
+            return KeyEvent { KeyCode::Paste, g_paste };
+        }
+    }
+}
+
+KeyEvent input$escape() {
+    auto buffered = input$buffered();
+
+    // A lone ESC is only a key of its own if nothing follows it shortly.
+    if (buffered.size() < 2 && !input$fill(g_escape_timeout))
+        return input$take(KeyCode::Unknown, 1);
+
+    buffered = input$buffered();
+
+    if (buffered[1] == 'O') {
+        // SS3, sent by HOME and END in application cursor mode
+        if (buffered.size() < 3 && !input$fill(g_escape_timeout))
+            return input$take(KeyCode::Unknown, 2);
+
+        switch (input$buffered()[2]) {
+        case 'H':
+            return input$take(KeyCode::Home, 3);
+        case 'F':
+            return input$take(KeyCode::End, 3);
+        default:
+            return input$take(KeyCode::Unknown, 3);
+        }
+    }
+
+    if (buffered[1] != '[')
+        return input$take(KeyCode::Unknown, 1);
+
+    // CSI: parameter bytes up to a final byte in [0x40, 0x7E].
+    auto length = size_t { 2 };
+
+    while (true) {
+        buffered = input$buffered();
+
+        for (; length < buffered.size(); length++) {
+            if (buffered[length] >= 0x40 && buffered[length] <= 0x7E)
+                break;
+        }
+
+        if (length < buffered.size())
+            break;
+
+        if (!input$fill(g_escape_timeout))
+            return input$take(KeyCode::Unknown, buffered.size());
+    }
+
+    auto sequence = buffered.substr(0, length + 1);
+
+    if (sequence == g_paste_begin)
+        return input$paste();
+
+    constexpr struct {
+        std::string_view sequence;
+        KeyCode code;
+    } keys[] = {
+        { "\x1b[A", KeyCode::Up },      { "\x1b[B", KeyCode::Down },      { "\x1b[C", KeyCode::Right },
+        { "\x1b[D", KeyCode::Left },    { "\x1b[H", KeyCode::Home },      { "\x1b[F", KeyCode::End },
+        { "\x1b[1~", KeyCode::Home },   { "\x1b[4~", KeyCode::End },      { "\x1b[3~", KeyCode::Delete },
+        { "\x1b[5~", KeyCode::PageUp }, { "\x1b[6~", KeyCode::PageDown },
+    };
+
+    for (auto const& [match, code] : keys) {
+        if (sequence == match)
+            return input$take(code, sequence.size());
+    }
+
+    return input$take(KeyCode::Unknown, sequence.size());
+}
+
+KeyEvent input$next() {
+    if (!input$pending() && !input$fill())
+        return KeyEvent { KeyCode::Closed, {} };
+
+    auto lead = static_cast<unsigned char>(g_buffer[g_begin]);
+
+    if (lead == '\x1b')
+        return input$escape();
+
+    // A UTF-8 sequence is inserted whole, read the rest of it if it was split.
+    auto length = size_t { lead >= 0xF0 ? 4u : lead >= 0xE0 ? 3u : lead >= 0xC0 ? 2u : 1u };
+
+    while (input$buffered().size() < length) {
+        if (!input$fill())
+            length = input$buffered().size();
+    }
+
+    return input$take(KeyCode::Text, length);
+}
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string_view>
+
+namespace BShell {
+enum class KeyCode {
+    Text,     // one character, a control character or a whole UTF-8 sequence
+    Paste,    // everything between the bracketed paste markers
+    Up,
+    Down,
+    Right,
+    Left,
+    Home,
+    End,
+    Delete,
+    PageUp,
+    PageDown,
+    Unknown,  // an escape sequence we do not handle
+    Closed    // end of input
+};
+
+struct KeyEvent {
+    KeyCode code;
+    std::string_view text; // valid until the next call to input$next
+};
+
+KeyEvent input$next();
+bool input$pending();
+}
@@ -1,74 +1,110 @@
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <signal.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "Capture.h"
+#include "CommandTable.h"
 #include "Commands.h"
+#include "Functions.h"
+#include "Glob.h"
 #include "Interpreter.h"
+#include "Metrics.h"
+#include "Spawn.h"
 #include "System.h"
 #include "Terminal.h"
+#include "Trace.h"
+#include "Variables.h"
 
 namespace BShell {
-std::vector<Process> g_processes;
+std::vector<int> g_pipe_status;
 int g_exit_fg = 0, g_exit_bg = 0;
+int g_loop_depth = 0, g_loop_break = 0;
+bool g_loop_continue = false;
+std::string g_script_name;
+std::vector<std::string> g_positional;
+int g_function_depth = 0;
+bool g_function_return = false;
+bool g_shell_exit = false;
+
+// Deeper calls are an error instead of a stack overflow.
+constexpr auto g_function_limit = 1000;
+
+int exit$status(int status) {
+    // Collapse a waitpid(2) status into the value reported by $?.
+    if (WIFSIGNALED(status))
+        return 128 + WTERMSIG(status);
+
+    return WEXITSTATUS(status);
+}
 
-std::string get$eval(Token const& token) {
-    // Recursively tokenize and parse eval string until we get something
-    auto tokens = Tokenizer(token.content.c_str()).tokens();
-    auto asts = Parser(std::move(tokens)).asts();
-    auto eval_io = Pipe {};
-    auto str = std::string {};
+Capture eval$spawn(Expression const& expr) {
+    // Recursively tokenize and parse eval string, the subshell runs the result.
+    auto tokenizer = Tokenizer(expr.content());
+    auto ast = Parser(tokenizer).ast();
 
-    if (pipe(eval_io.fd) < 0) {
-        perror("pipe()");
-        exit(1);
-    }
+    return capture$spawn([&] {
+        for (auto root : ast.roots()) {
+            handle$ast(ast.at(root));
 
-    for (auto&& ast : asts) {
-        handle$ast(std::move(ast), [&] {
-            dup2(eval_io.fd[1], STDOUT_FILENO);
-            std::cout.flush();
+            if (g_shell_exit)
+                break;
+        }
+    });
+}
 
-            close(eval_io.fd[0]);
-            close(eval_io.fd[1]);
-        });
-    }
+std::string get$eval(Expression const& expr) {
+    auto captures = std::vector<Capture> { eval$spawn(expr) };
 
-    write(eval_io.fd[1], NULL, 1);
-    close(eval_io.fd[1]);
+    capture$drain(captures);
 
-    auto buf = std::make_unique<char[]>(BUFSIZ);
-    auto fmem = fdopen(eval_io.fd[0], "r");
+    return std::move(captures.front().output);
+}
 
-    while (fgets(buf.get(), BUFSIZ, fmem))
-        str += std::string { buf.get() };
+std::vector<std::string> get$evals(Expression const& expr) {
+    // Every substitution of a command is started before any of them is read, so they
+    // take as long as the slowest one instead of their sum. Each has its own pipe and
+    // the results are spliced back into argv in order.
+    auto captures = std::vector<Capture> {};
 
-    close(eval_io.fd[0]);
+    for (auto const& child : expr.children())
+        if (child.type() == Eval)
+            captures.push_back(eval$spawn(child));
 
-    return str;
-}
+    capture$drain(captures);
 
-void handle$argv_strings(std::vector<std::string>& argv, bool& sticky, Token const& token) {
-    auto str = token.content;
+    auto outputs = std::vector<std::string> {};
 
-    if (token.type == Eval)
-        str = get$eval(token);
+    for (auto& capture : captures)
+        outputs.push_back(std::move(capture.output));
 
-    if (sticky || token.type & StickyLeft) {
+    return outputs;
+}
+
+void handle$argv_strings(std::vector<std::string>& argv, bool& sticky, Expression const& expr,
+                         std::string str) {
+    if ((sticky || expr.type() & StickyLeft) && argv.size()) {
         sticky = false;
 
         str = argv.back() + str;
         argv.pop_back();
     }
 
-    if (token.type & StickyRight)
+    if (expr.type() & StickyRight)
         sticky = true;
 
     // Remove unprintable control characters like SOH, STX, ETX, etc.
@@ -78,66 +114,275 @@ void handle$argv_strings(std::vector<std::string>& argv, bool& sticky, Token con
     argv.push_back(str);
 }
 
-void handle$keyword(std::shared_ptr<Expression> const& expr) {
-    auto kw = expr->token.content;
-    auto index = std::distance(g_keywords.find(kw), g_keywords.end());
+std::optional<std::string> expand$parameter(std::string_view name) {
+    if (name == "?")
+        return std::to_string(g_exit_fg);
+
+    if (name == "!")
+        return g_exit_bg ? std::optional { std::to_string(g_exit_bg) } : std::nullopt;
+
+    if (name == "$")
+        return std::to_string(var$pid());
+
+    if (name == "#")
+        return std::to_string(g_positional.size());
+
+    if (name == "@" || name == "*") {
+        auto all = std::string {};
+
+        for (auto const& word : g_positional)
+            (all += all.empty() ? "" : " ") += word;
 
-    // TODO: Maybe use an enum for more readability
-    switch (index) {
-    case 1: // export
-        break;
-    case 2: // cd
-        command$cd(expr);
-        break;
-    case 3: // jobs
-        break;
+        return all;
     }
+
+    auto digits = std::all_of(name.begin(), name.end(), [](char c) { return std::isdigit(c); });
+
+    if (name.size() && digits) {
+        auto n = strtoul(std::string { name }.c_str(), nullptr, 10);
+
+        if (!n)
+            return g_script_name;
+
+        return n <= g_positional.size() ? std::optional { g_positional[n - 1] } : std::nullopt;
+    }
+
+    if (auto* value = var$get(name))
+        return std::string { value };
+
+    return std::nullopt;
 }
 
-void handle$io_redirect(int fd, std::shared_ptr<Expression> const& redir) {
-    if (redir == nullptr)
-        return;
+size_t expand$close(std::string_view word, size_t i) {
+    // The '}' that closes a "${" ending right before i.
+    for (auto depth = 1; i < word.size(); i++) {
+        if (word[i] == '\\')
+            i++;
+        else if (word[i] == '{')
+            depth++;
+        else if (word[i] == '}' && !--depth)
+            return i;
+    }
 
-    auto filename = redir->token.content;
+    return std::string_view::npos;
+}
 
-    if (!(redir->token.type & (String | StickyLeft)))
-        filename = get$eval(redir->token);
+std::string expand$braces(std::string_view inner) {
+    // ${#name}, ${name}, and ${name-word}, ${name=word}, ${name+word}, which with a
+    // colon also treat an empty value as unset.
+    if (inner.size() > 1 && inner[0] == '#') {
+        auto value = expand$parameter(inner.substr(1));
 
-    auto flags = O_CREAT;
-    flags |= (fd == STDIN_FILENO) ? O_RDWR : O_WRONLY;
+        return std::to_string(value ? value->size() : 0);
+    }
 
-    auto file = open(filename.c_str(), flags, 0644);
+    auto end = inner.find_first_of(":-=+", 1);
+    auto name = inner.substr(0, end);
+    auto value = expand$parameter(name);
 
-    if (file < 0)
-        perror("open()");
+    if (end == std::string_view::npos)
+        return value.value_or("");
 
-    if (dup2(file, fd) < 0) {
-        perror("dup2()");
-        exit(1);
+    auto colon = inner[end] == ':';
+    auto op = end + colon < inner.size() ? inner[end + colon] : '\0';
+    auto word = inner.substr(std::min(end + colon + 1, inner.size()));
+    auto unset = !value || (colon && value->empty());
+
+    switch (op) {
+    case '-':
+        return unset ? expand$word(word, false) : *value;
+    case '=':
+        if (!unset)
+            return *value;
+
+        value = expand$word(word, false);
+
+        if (var$valid(name))
+            var$set(name, *value);
+
+        return *value;
+    case '+':
+        return unset ? "" : expand$word(word, false);
     }
 
-    std::cout.flush();
+    return value.value_or("");
+}
+
+std::string expand$word(std::string_view word, bool pattern) {
+    // One pass over the escaped text of a word: parameters are replaced by their value
+    // and escaped characters are copied. A pattern keeps its escapes for Glob, and the
+    // values are escaped so that they only match themselves.
+    auto out = std::string {};
+    auto value = [&](std::string_view value) { out += pattern ? glob$escape(value) : value; };
+    auto name = [](char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; };
+    auto special = [](char c) { return (c && strchr("?!$#@*", c)) || (c >= '0' && c <= '9'); };
+
+    out.reserve(word.size());
+
+    for (auto i = size_t {}; i < word.size(); i++) {
+        auto c = word[i];
+        auto next = i + 1 < word.size() ? word[i + 1] : '\0';
+
+        if (c == '\\' && next) {
+            if (pattern)
+                out += c;
+
+            out += word[++i];
+        } else if (c != '$') {
+            out += c;
+        } else if (special(next)) {
+            value(expand$parameter(word.substr(++i, 1)).value_or(""));
+        } else if (auto end = next == '{' ? expand$close(word, i + 2) : 0) {
+            if (end == std::string_view::npos) {
+                out += c;
+                continue;
+            }
+
+            value(expand$braces(word.substr(i + 2, end - i - 2)));
+            i = end;
+        } else if (name(next) && !std::isdigit(static_cast<unsigned char>(next))) {
+            auto end = i + 1;
+
+            while (end < word.size() && name(word[end]))
+                end++;
+
+            if (auto* found = var$get(word.substr(i + 1, end - i - 1)))
+                value(found);
+
+            i = end - 1;
+        } else {
+            out += c;
+        }
+    }
 
-    close(file);
+    return out;
 }
 
-std::vector<std::string> handle$argv(std::shared_ptr<Expression> const& expr) {
-    auto argv = std::vector<std::string> { expr->token.content };
+std::string handle$word(Expression const& expr) {
+    // What a word stands for, parameters expanded but no pathname expansion.
+    if (expr.flags() & Expand)
+        return expand$word(expr.content(), false);
+
+    if (expr.flags() & Wildcard)
+        return glob$literal(expr.content());
+
+    return std::string { expr.content() };
+}
+
+std::string handle$pattern(Expression const& expr) {
+    // A word as a pattern, only the parts that were not quoted match more than themselves.
+    if (!(expr.flags() & Wildcard))
+        return glob$escape(handle$word(expr));
+
+    if (expr.flags() & Expand)
+        return expand$word(expr.content(), true);
+
+    return std::string { expr.content() };
+}
+
+bool handle$argv_fields(std::vector<std::string>& argv, bool& sticky, Expression const& expr) {
+    // "$@" is one field per positional parameter, and none at all when there are none.
+    // Text around it is glued to the first and the last of them. Returns false when the
+    // word has no $@.
+    auto word = expr.content();
+    auto at = std::string_view::npos, length = size_t {};
+
+    for (auto i = size_t {}; i < word.size() && at == std::string_view::npos; i++) {
+        if (word[i] == '\\')
+            i++;
+        else if (word.substr(i).starts_with("$@"))
+            at = i, length = 2;
+        else if (word.substr(i).starts_with("${@}"))
+            at = i, length = 4;
+    }
+
+    if (at == std::string_view::npos)
+        return false;
+
+    auto prefix = expand$word(word.substr(0, at), false);
+    auto suffix = expand$word(word.substr(at + length), false);
+    auto fields = g_positional;
+
+    if (fields.empty() && prefix.empty() && suffix.empty())
+        return true;
+
+    if (fields.empty())
+        fields.emplace_back();
+
+    fields.front().insert(0, prefix);
+    fields.back() += suffix;
+
+    handle$argv_strings(argv, sticky, expr, std::move(fields.front()));
+    argv.insert(argv.end(), std::make_move_iterator(fields.begin() + 1),
+                std::make_move_iterator(fields.end()));
+
+    return true;
+}
+
+void handle$argv_word(std::vector<std::string>& argv, bool& sticky, Expression const& expr) {
+    // A pattern becomes the paths it matches, or stays as typed when nothing matches.
+    // Glued to the output of a substitution it is taken literally.
+    if (expr.flags() & Expand && !(expr.flags() & Wildcard)
+        && handle$argv_fields(argv, sticky, expr))
+        return;
+
+    if (!(expr.flags() & Wildcard) || sticky || expr.type() != String)
+        return handle$argv_strings(argv, sticky, expr, handle$word(expr));
+
+    auto pattern = handle$pattern(expr);
+    auto paths = std::vector<std::string> {};
+
+    if (!Glob { pattern }.expand(paths)) {
+        std::cerr << glob$literal(pattern) << ": more than " << g_glob_limit << " matches\n";
+        paths.clear();
+    }
+
+    if (paths.empty())
+        return handle$argv_strings(argv, sticky, expr, glob$literal(pattern));
+
+    argv.insert(argv.end(), std::make_move_iterator(paths.begin()),
+                std::make_move_iterator(paths.end()));
+}
+
+FileAction handle$io_redirect(int fd, Expression const& redir) {
+    auto filename = redir.type() & (String | StickyLeft) ? handle$word(redir) : get$eval(redir);
+
+    auto flags = O_CREAT;
+    flags |= (fd == STDIN_FILENO) ? O_RDWR : O_WRONLY;
+
+    return FileAction { FileAction::Open, fd, -1, flags, std::move(filename) };
+}
+
+std::vector<std::string> handle$argv(Expression const& expr, FileActions& actions) {
+    TRACE_SCOPE("argv");
+
+    // Arguments and redirections are resolved in the shell, the child only has to
+    // apply the resulting file actions.
+    auto argv = std::vector<std::string> { std::string { expr.content() } };
     auto sticky = false;
+    auto evals = get$evals(expr);
+    auto eval = evals.begin();
 
-    for (auto const& child : expr->children) {
-        switch (child->token.type) {
-        case StickyRight:
+    for (auto const& child : expr.children()) {
+        switch (child.type()) {
         case Eval:
+            handle$argv_strings(argv, sticky, child, std::move(*eval++));
+            break;
+        case StickyRight:
         case String:
         case StickyLeft:
-            handle$argv_strings(argv, sticky, child->token);
+            if (child.flags() & (Wildcard | Expand))
+                handle$argv_word(argv, sticky, child);
+            else
+                handle$argv_strings(argv, sticky, child, std::string { child.content() });
             break;
         case RedirectIn:
-            handle$io_redirect(STDIN_FILENO, child->children[0]);
+            actions.push_back(handle$io_redirect(STDIN_FILENO, child.front()));
             break;
         case RedirectOut:
-            handle$io_redirect(STDOUT_FILENO, child->children[0]);
+            actions.push_back(handle$io_redirect(STDOUT_FILENO, child.front()));
+            break;
+        default:
             break;
         }
     }
@@ -145,141 +390,440 @@ std::vector<std::string> handle$argv(std::shared_ptr<Expression> const& expr) {
     return argv;
 }
 
-Process execute(std::shared_ptr<Expression> const& expr, std::function<void()> child_hook) {
-    auto pid = fork();
+Process execute(Expression const& expr, FileActions actions, pid_t pgroup,
+                ChildHook child_hook = {}) {
+    // A compound command in a pipeline runs in a fork of the shell, its commands are
+    // jobs of that subshell.
+    if (expr.type() == Compound) {
+        auto pid = spawn$fork(actions, [&] {
+            jobs$subshell();
+            handle$ast(expr);
+            return g_exit_fg;
+        }, pgroup);
+
+        return Process { pid, get$pname(expr) };
+    }
 
-    if (pid < 0) {
-        perror("fork()");
-        exit(1);
-    } else if (!pid) {
-        auto args = handle$argv(expr);
-        auto argv = std::vector<char*> {};
+    auto args = handle$argv(expr, actions);
+    auto pid = pid_t { -1 };
+
+    // A builtin or function that has to run alongside other processes gets a fork of
+    // the shell.
+    if (!child_hook && expr.type() == Key)
+        child_hook = builtin$find(args[0]);
+    else if (!child_hook && expr.type() == Function && function$find(args[0]))
+        child_hook = handle$function;
+
+    if (child_hook) {
+        // Only code that has to run inside the child pays for a full fork().
+        pid = spawn$fork(actions, [&] { return child_hook(args); }, pgroup);
+    } else if (auto path = hash$lookup(args[0]); path.size()) {
+        pid = spawn$process(path, args, actions, pgroup);
+    } else {
+        std::cerr << args[0] << ": command not found\n";
+    }
 
-        std::transform(args.begin(), args.end(), std::back_inserter(argv),
-                       [](std::string const& str) { return const_cast<char*>(str.c_str()); });
+    return Process { pid, get$pname(expr) };
+}
 
-        argv.push_back(NULL);
+bool handle$measured(Expression const& expr) {
+    return expr.flags() & Timed || metrics$enabled();
+}
 
-        child_hook();
+void handle$metrics(Expression const& expr, Metrics const& metrics) {
+    if (expr.flags() & Timed)
+        metrics$print(metrics);
 
-        execvp(argv[0], &argv[0]);
+    metrics$log(metrics);
+}
 
-        perror("execvp()");
-        exit(1);
+void handle$keyword(Expression const& expr) {
+    // Builtins and functions run in the shell, with redirections applied to the shell's
+    // own descriptors for as long as they run.
+    auto measured = handle$measured(expr);
+    auto start = Timestamp {};
+    auto before = rusage {}, after = rusage {};
+    auto actions = FileActions {};
+    auto saved = SavedFds {};
+
+    if (measured) {
+        start = metrics$now();
+        getrusage(RUSAGE_SELF, &before);
     }
 
-    return Process { pid, get$pname(expr) };
+    auto args = handle$argv(expr, actions);
+
+    std::cout.flush();
+
+    {
+        TRACE_SCOPE("builtin");
+        g_exit_fg = !spawn$redirect(actions, saved) ? 1
+            : expr.type() == Function               ? handle$function(args)
+                                                    : builtin$find(args[0])(args);
+    }
+
+    std::cout.flush();
+    spawn$restore(saved);
+
+    if (measured) {
+        getrusage(RUSAGE_SELF, &after);
+        handle$metrics(expr, metrics$measure(get$pname(expr), g_exit_fg, start,
+                                             rusage$diff(after, before)));
+    }
 }
 
-void handle$executable(std::shared_ptr<Expression> const& expr, std::function<void()> hook) {
-    auto proc = execute(expr, hook);
+FileActions handle$foreground() {
+    // Foreground jobs take the terminal as soon as they exist.
+    if (!g_job_control)
+        return {};
 
-    waitpid(proc.pid, &g_exit_fg, 0);
+    return FileActions { FileAction { FileAction::Foreground, STDIN_FILENO } };
 }
 
-void handle$background(std::shared_ptr<Expression> const& expr) {
-    auto proc = execute(expr->children[0], [=] {});
+void handle$executable(Expression const& expr) {
+    auto job = Job {};
+
+    jobs$add(job, execute(expr, handle$foreground(), jobs$pgroup(job)));
 
-    std::cout << '[' << g_processes.size() + 1 << "] " << proc.pid << '\n';
+    g_exit_fg = jobs$foreground(job);
 
-    waitpid(proc.pid, &g_exit_bg, WNOHANG);
-    g_processes.push_back(Process { proc.pid, proc.name });
+    if (job.state == JobState::Done && handle$measured(expr))
+        handle$metrics(expr, metrics$measure(job.name, g_exit_fg, job.start, job.usage));
 }
 
-void handle$sequential(std::shared_ptr<Expression> const& expr) {
-    for (auto const& child : expr->children) {
-        auto proc = Process {};
+void handle$background(Expression const& expr) {
+    auto job = Job {};
+
+    jobs$add(job, execute(expr.front(), {}, jobs$pgroup(job)));
+
+    if (!job.live)
+        return;
 
-        proc = execute(child, [&]() -> void {});
+    g_exit_bg = job.pids.back();
 
-        waitpid(proc.pid, &g_exit_fg, 0);
+    std::cout << '[' << jobs$background(std::move(job)) << "] " << g_exit_bg << '\n';
+}
+
+bool handle$unwinding() {
+    // break, continue, return or exit was run, the lists around it stop.
+    return g_loop_break || g_loop_continue || g_function_return || g_shell_exit;
+}
+
+void handle$sequential(Expression const& expr) {
+    for (auto const& child : expr.children()) {
+        // Dispatch through handle$ast so pipelines in a sequence use the pipeline executor.
+        handle$ast(child);
+
+        if (handle$unwinding())
+            break;
 
-        if (expr->token.type == SequentialIf && g_exit_fg != 0)
+        if (expr.type() == SequentialIf && g_exit_fg != 0)
             break;
     }
 }
 
-void handle$pipe(std::shared_ptr<Expression> const& expr, std::function<void()> last_hook) {
-    auto last_io = Pipe {};
+bool handle$next() {
+    // Whether the loop that just ran a list goes on. A command killed by ^C stops the
+    // loop too, or `while true; do sleep 1; done` could never be interrupted.
+    if (g_function_return || g_shell_exit)
+        return false;
 
-    for (auto const& child : expr->children) {
-        // TODO: Maybe figure out something other than this callback structure.
-        auto proc = Process {};
-        auto proc_io = Pipe {};
+    if (g_loop_break) {
+        g_loop_break--;
+        return false;
+    }
 
-        if (pipe(proc_io.fd) < 0) {
-            perror("pipe()");
-            exit(1);
+    if (g_loop_continue) {
+        g_loop_continue = false;
+        return true;
+    }
+
+    return g_exit_fg != 128 + SIGINT;
+}
+
+void handle$if(Expression const& expr) {
+    // Conditions and their lists alternate, an odd one out at the end is the else.
+    auto children = expr.children();
+
+    for (auto it = children.begin(); it != children.end(); ++it) {
+        auto list = *it;
+
+        if (++it == children.end())
+            return handle$ast(list);
+
+        handle$ast(list);
+
+        if (handle$unwinding())
+            return;
+
+        if (!g_exit_fg)
+            return handle$ast(*it);
+    }
+
+    g_exit_fg = 0;
+}
+
+void handle$while(Expression const& expr, bool until) {
+    auto status = 0;
+
+    g_loop_depth++;
+
+    while (true) {
+        handle$ast(expr.front());
+
+        if (!handle$next() || (g_exit_fg == 0) == until)
+            break;
+
+        handle$ast(expr.back());
+        status = g_exit_fg;
+
+        if (!handle$next())
+            break;
+    }
+
+    g_loop_depth--;
+    g_exit_fg = status;
+}
+
+std::vector<std::string> handle$for_words(Expression const& expr) {
+    // The words are expanded like arguments, only the output of a substitution is
+    // split into fields at whitespace.
+    auto words = std::vector<std::string> {};
+    auto sticky = false;
+    auto evals = get$evals(expr);
+    auto eval = evals.begin();
+
+    for (auto const& child : expr.children()) {
+        if (child.type() != Eval) {
+            handle$argv_word(words, sticky, child);
+            continue;
         }
 
-        proc = execute(child, [&]() -> void {
-            // This entire lambda function executes within the child process.
-            if (child != expr->children.front()) {
-                dup2(last_io.fd[0], STDIN_FILENO);
+        auto output = std::string_view { *eval++ };
+        auto first = true;
 
-                close(last_io.fd[0]);
-                close(last_io.fd[1]);
-            }
+        while (output.size()) {
+            auto start = output.find_first_not_of(" \t\n");
+            auto end = output.find_first_of(" \t\n", start);
+
+            if (start == std::string_view::npos)
+                break;
 
-            if (child != expr->children.back())
-                dup2(proc_io.fd[1], STDOUT_FILENO);
+            auto field = std::string { output.substr(start, end - start) };
+
+            if (first)
+                handle$argv_strings(words, sticky, child, std::move(field));
             else
-                last_hook();
+                words.push_back(std::move(field));
 
-            close(proc_io.fd[0]);
-            close(proc_io.fd[1]);
-        });
+            first = false;
+            output.remove_prefix(end == std::string_view::npos ? output.size() : end);
+        }
+    }
 
-        if (child != expr->children.front()) {
-            // Close the file descriptor in the parent process.
-            close(last_io.fd[0]);
-            close(last_io.fd[1]);
+    return words;
+}
+
+void handle$for(Expression const& expr) {
+    // The list runs straight from the AST, an iteration only costs the assignment and
+    // whatever its commands cost.
+    auto name = expr.front().content();
+    auto in = expr.child(1);
+    auto words = in.content().empty() ? g_positional : handle$for_words(in);
+
+    g_exit_fg = 0;
+    g_loop_depth++;
+
+    for (auto const& word : words) {
+        var$set(name, word);
+        handle$ast(expr.back());
+
+        if (!handle$next())
+            break;
+    }
+
+    g_loop_depth--;
+}
+
+void handle$case(Expression const& expr) {
+    auto word = expr.front().type() == Eval ? get$eval(expr.front()) : handle$word(expr.front());
+    auto items = expr.children();
+
+    g_exit_fg = 0;
+
+    // The first item with a matching pattern runs, the patterns are all but its last child.
+    for (auto it = ++items.begin(); it != items.end(); ++it) {
+        auto item = *it;
+
+        for (auto const& pattern : item.children()) {
+            if (pattern == item.back())
+                break;
+
+            if (glob$match(handle$pattern(pattern), word))
+                return handle$ast(item.back());
         }
+    }
+}
 
-        last_io = proc_io;
+int handle$function(std::vector<std::string> const& args) {
+    // A call is one lookup, the body runs from the Ast it was parsed into. The
+    // arguments become $1, $2, ... for as long as it runs, and loops outside of it
+    // cannot be left from inside.
+    auto function = function$find(args[0]);
 
-        if (waitpid(-1, &g_exit_fg, 0) < 0) {
-            perror("waitpid()");
+    if (!function) {
+        std::cerr << args[0] << ": command not found\n";
+        return 127;
+    }
+
+    if (g_function_depth >= g_function_limit) {
+        std::cerr << args[0] << ": maximum function nesting level exceeded\n";
+        return 1;
+    }
+
+    auto positional = std::exchange(g_positional, { args.begin() + 1, args.end() });
+    auto loops = std::exchange(g_loop_depth, 0);
+
+    g_function_depth++;
+    handle$ast(function->ast.at(function->body));
+    g_function_depth--;
+
+    g_function_return = false;
+    g_loop_depth = loops;
+    g_positional = std::move(positional);
+
+    return g_exit_fg;
+}
+
+void handle$redirected(Expression const& expr) {
+    // A compound command runs in the shell, like a builtin its redirections are applied
+    // to the shell's own descriptors for as long as it runs.
+    auto actions = FileActions {};
+    auto saved = SavedFds {};
+
+    for (auto const& child : expr.children()) {
+        if (child.type() == RedirectIn)
+            actions.push_back(handle$io_redirect(STDIN_FILENO, child.front()));
+        else if (child.type() == RedirectOut)
+            actions.push_back(handle$io_redirect(STDOUT_FILENO, child.front()));
+    }
+
+    std::cout.flush();
+
+    if (spawn$redirect(actions, saved))
+        handle$ast(expr.front());
+    else
+        g_exit_fg = 1;
+
+    std::cout.flush();
+    spawn$restore(saved);
+}
+
+void handle$compound(Expression const& expr) {
+    auto keyword = expr.content();
+
+    if (keyword == ">" || keyword == "<") {
+        handle$redirected(expr);
+    } else if (keyword == "()") {
+        function$define(expr.front().content(), expr.back());
+        g_exit_fg = 0;
+    } else if (keyword == "{") {
+        handle$ast(expr.front());
+    } else if (keyword == "if") {
+        handle$if(expr);
+    } else if (keyword == "for") {
+        handle$for(expr);
+    } else if (keyword == "case") {
+        handle$case(expr);
+    } else {
+        handle$while(expr, keyword == "until");
+    }
+}
+
+void handle$pipe(Expression const& expr) {
+    // Every stage is started before any of them is waited on, otherwise a producer
+    // writing more than a pipe buffer would block forever on a consumer that does not
+    // exist yet. The parent only holds the read end of the previous stage while the
+    // next one is being spawned.
+    auto last_stage = expr.back();
+    auto job = Job {};
+    auto last_io = Pipe { -1, -1 };
+
+    for (auto const& child : expr.children()) {
+        auto proc_io = Pipe { -1, -1 };
+        auto actions = handle$foreground();
+        auto last = child == last_stage;
+
+        if (!last && pipe(proc_io.fd) < 0) {
+            perror("pipe()");
             exit(1);
         }
+
+        if (last_io.fd[0] >= 0) {
+            actions.push_back(FileAction { FileAction::Dup, STDIN_FILENO, last_io.fd[0] });
+            actions.push_back(FileAction { FileAction::Close, last_io.fd[0] });
+        }
+
+        if (!last) {
+            actions.push_back(FileAction { FileAction::Dup, STDOUT_FILENO, proc_io.fd[1] });
+            actions.push_back(FileAction { FileAction::Close, proc_io.fd[0] });
+            actions.push_back(FileAction { FileAction::Close, proc_io.fd[1] });
+        }
+
+        // Every stage joins the process group of the first one.
+        jobs$add(job, execute(child, std::move(actions), jobs$pgroup(job)));
+
+        // Close the parent's copies, the children now own both ends.
+        if (last_io.fd[0] >= 0)
+            close(last_io.fd[0]);
+
+        if (!last)
+            close(proc_io.fd[1]);
+
+        last_io = proc_io;
     }
+
+    g_exit_fg = jobs$foreground(job);
+    g_pipe_status = job.status;
+
+    if (job.state == JobState::Done && handle$measured(expr))
+        handle$metrics(expr, metrics$measure(job.name, g_exit_fg, job.start, job.usage));
 }
 
-void handle$ast(std::shared_ptr<Expression>&& ast, std::function<void()> hook) {
-    switch (ast->token.type) {
+void handle$ast(Expression const& ast) {
+    TRACE_SCOPE("execute");
+
+#if DEBUG_AST
+    std::cout << "--{AST Begin}--\n";
+    BShell::ast$print(ast);
+    std::cout << "--{AST End}--\n";
+#endif
+
+    switch (ast.type()) {
     case Key:
         return handle$keyword(ast);
+    case Function:
+        // A word the tokenizer did not know is run as a command unless it names a
+        // function by now.
+        if (function$find(ast.content()))
+            return handle$keyword(ast);
+
+        return handle$executable(ast);
     case Executable:
-        return handle$executable(ast, hook);
+        return handle$executable(ast);
     case Background:
         return handle$background(ast);
     case RedirectPipe:
-        return handle$pipe(ast, hook);
+        return handle$pipe(ast);
     case SequentialIf:
     case Sequential:
         return handle$sequential(ast);
     case Equal:
         return command$set_env(ast);
+    case Compound:
+        return handle$compound(ast);
     default:
         std::cerr << "Bad token type passed to handle$ast\n";
     }
 }
-
-void handle$ast(std::shared_ptr<Expression>&& ast) {
-#if DEBUG_AST
-    std::cout << "--{AST Begin}--\n";
-    BShell::ast$print(ast);
-    std::cout << "--{AST End}--\n";
-#endif
-
-    handle$ast(std::move(ast), [=]() {});
-}
-
-void erase_dead_children() {
-    g_processes.erase(std::remove_if(g_processes.begin(), g_processes.end(),
-                                     [=](Process const& proc) -> bool {
-                                         return waitpid(proc.pid, &g_exit_bg, WNOHANG) != 0;
-                                     }),
-                      g_processes.end());
-}
 }
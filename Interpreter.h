@@ -1,8 +1,11 @@
 #pragma once
 
 #include <functional>
+#include <string>
+#include <string_view>
 #include <vector>
 
+#include "Jobs.h"
 #include "Parser.h"
 #include "Tokenizer.h"
 
@@ -11,24 +14,39 @@ struct Pipe {
     int fd[2];
 };
 
-struct Process {
-    pid_t pid;
-    std::string name;
-};
-
 enum KEYWORD { UNKNOWN, EXPORT, CD };
 
-void erase_dead_children();
+int exit$status(int);
+
+void handle$argv_strings(std::vector<std::string>&, bool&, Expression const&, std::string);
+std::string handle$word(Expression const&);
+// The output of a command substitution, its trailing newlines dropped.
+std::string get$eval(Expression const&);
+// Expands $name, ${...}, $?, $! and $$ in the escaped text of a word, a pattern (true)
+// keeps its escapes.
+std::string expand$word(std::string_view, bool);
+
+// Runs inside a forked child in place of exec, returns the child's exit status.
+using ChildHook = std::function<int(std::vector<std::string> const&)>;
 
-void handle$argv_strings(std::vector<std::string>&, bool&, Token const&);
+// Calls the function argv[0] names, returns its exit status.
+int handle$function(std::vector<std::string> const&);
 
-void handle$ast(std::shared_ptr<Expression>&& ast, std::function<void()> hook);
-void handle$ast(std::shared_ptr<Expression>&&);
+void handle$ast(Expression const&);
 
-extern std::string g_prev_wd;
-extern std::vector<Process> g_processes;
+extern std::vector<int> g_pipe_status; // exit status of each stage of the last pipeline
 
-// TODO: Implement $? and $! to get the exit code of processes.
 extern int g_exit_fg; // $?
-extern int g_exit_bg; // $!
+extern int g_exit_bg; // $!, the pid of the last background job
+
+// break and continue, every list stops once either is set and the loops act on it.
+extern int g_loop_depth;      // loops being run
+extern int g_loop_break;      // loops still to leave
+extern bool g_loop_continue;  // the loop reached then goes on with its next iteration
+
+extern std::string g_script_name;             // $0
+extern std::vector<std::string> g_positional; // $1, $2, ... of the script or function being run
+extern int g_function_depth;
+extern bool g_function_return; // return was run, the lists of the function stop
+extern bool g_shell_exit;      // exit was run, every list stops and the shell exits with $?
 }
@@ -0,0 +1,337 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Interpreter.h"
+#include "Jobs.h"
+#include "Metrics.h"
+#include "Trace.h"
+
+namespace BShell {
+bool g_job_control = false;
+
+// Jobs by id, and the job id of every process that has not been reaped yet.
+std::map<int, Job> g_jobs;
+std::unordered_map<pid_t, int> g_job_pids;
+
+// SIGCHLD is blocked and delivered here instead, so checking for finished jobs
+// is a single read() no matter how many jobs there are.
+int g_sigchld_fd = -1;
+
+void jobs$init(bool interactive) {
+    auto mask = sigset_t {};
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+
+    if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0)
+        perror("sigprocmask()");
+
+    if ((g_sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+        perror("signalfd()");
+
+    // Scripts leave every job in the shell's process group, even when run from a terminal.
+    if (!interactive || !isatty(STDIN_FILENO))
+        return;
+
+    // Put the shell in its own process group and take the terminal, jobs get their
+    // own groups so terminal signals only reach the foreground job.
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    setpgid(0, 0);
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+
+    g_job_control = true;
+}
+
+void jobs$subshell() {
+    // A forked subshell (e.g. for $()) neither owns the parent's jobs nor the terminal.
+    g_job_control = false;
+    g_jobs.clear();
+    g_job_pids.clear();
+
+    if (g_sigchld_fd >= 0)
+        close(g_sigchld_fd);
+
+    g_sigchld_fd = -1;
+}
+
+pid_t jobs$pgroup(Job const& job) {
+    // Process group for the next process of job, -1 leaves it in the shell's group.
+    return g_job_control ? job.pgid : -1;
+}
+
+void jobs$add(Job& job, Process const& proc) {
+    if (job.name.size())
+        job.name += " | ";
+
+    job.name += proc.name;
+
+    if (proc.pid < 0) {
+        job.pids.push_back(proc.pid);
+        job.status.push_back(127);
+        return;
+    }
+
+    if (!job.pgid)
+        job.pgid = proc.pid;
+
+    job.pids.push_back(proc.pid);
+    job.status.push_back(-1);
+    job.live++;
+}
+
+void jobs$update(Job& job, size_t i, int status, rusage const& usage) {
+    if (WIFSTOPPED(status)) {
+        // Every process of a stopped pipeline reports, only the first one is news.
+        if (job.state != JobState::Stopped)
+            job.notified = false;
+
+        job.state = JobState::Stopped;
+        return;
+    }
+
+    if (WIFCONTINUED(status)) {
+        job.state = JobState::Running;
+        return;
+    }
+
+    job.status[i] = exit$status(status);
+    job.live--;
+
+    rusage$add(job.usage, usage);
+
+    if (!job.live) {
+        job.state = JobState::Done;
+        job.notified = false;
+    }
+}
+
+int jobs$status(Job const& job) {
+    // A job's status is that of its last process, like a pipeline.
+    return job.status.size() ? job.status.back() : 0;
+}
+
+int jobs$add_to_table(Job&& job) {
+    if (!job.id)
+        job.id = g_jobs.size() ? g_jobs.rbegin()->first + 1 : 1;
+
+    for (auto i = size_t {}; i < job.pids.size(); i++)
+        if (job.status[i] < 0)
+            g_job_pids[job.pids[i]] = job.id;
+
+    auto id = job.id;
+    g_jobs[id] = std::move(job);
+
+    return id;
+}
+
+int jobs$wait(Job& job, bool untraced) {
+    TRACE_SCOPE("wait");
+
+    // Blocks until every process of job has exited, or until one of them stops.
+    auto running = job.live > 0;
+
+    for (auto i = size_t {}; i < job.pids.size() && job.live; i++) {
+        if (job.status[i] >= 0)
+            continue;
+
+        auto status = 0;
+        auto usage = rusage {};
+
+        if (wait4(job.pids[i], &status, untraced ? WUNTRACED : 0, &usage) < 0) {
+            if (errno != ECHILD)
+                perror("wait4()");
+
+            job.status[i] = 127;
+            job.live--;
+            continue;
+        }
+
+        g_job_pids.erase(job.pids[i]);
+        jobs$update(job, i, status, usage);
+
+        if (job.state == JobState::Stopped)
+            return 128 + WSTOPSIG(status);
+    }
+
+    job.state = JobState::Done;
+
+    // A job with an id came from the table, wait and fg finish what ran in the
+    // background. The interpreter logs the foreground jobs it starts itself.
+    if (running && job.id)
+        metrics$log(metrics$measure(job.name, jobs$status(job), job.start, job.usage));
+
+    return jobs$status(job);
+}
+
+int jobs$foreground(Job& job) {
+    if (g_job_control && job.pgid > 0)
+        tcsetpgrp(STDIN_FILENO, job.pgid);
+
+    job.state = JobState::Running;
+
+    auto status = jobs$wait(job, g_job_control);
+
+    if (g_job_control)
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+
+    if (job.state == JobState::Stopped) {
+        auto id = jobs$add_to_table(Job { job });
+
+        g_jobs[id].notified = true;
+        std::cout << "\n[" << id << "] Stopped " << job.name << '\n';
+    }
+
+    return status;
+}
+
+int jobs$background(Job&& job) {
+    job.state = JobState::Running;
+    job.notified = true;
+
+    return jobs$add_to_table(std::move(job));
+}
+
+void jobs$poll() {
+    auto info = signalfd_siginfo {};
+    auto pending = g_sigchld_fd < 0;
+
+    while (g_sigchld_fd >= 0 && read(g_sigchld_fd, &info, sizeof(info)) == sizeof(info))
+        pending = true;
+
+    if (!pending)
+        return;
+
+    // Only reached when a child actually changed state, each iteration reaps one.
+    auto status = 0;
+    auto pid = pid_t {};
+    auto usage = rusage {};
+
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0) {
+        auto entry = g_job_pids.find(pid);
+
+        if (entry == g_job_pids.end())
+            continue;
+
+        auto& job = g_jobs[entry->second];
+
+        for (auto i = size_t {}; i < job.pids.size(); i++)
+            if (job.pids[i] == pid)
+                jobs$update(job, i, status, usage);
+
+        // Foreground jobs are logged by the interpreter, these finished on their own.
+        if (job.state == JobState::Done)
+            metrics$log(metrics$measure(job.name, jobs$status(job), job.start, job.usage));
+
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+            g_job_pids.erase(entry);
+    }
+}
+
+void jobs$notify(bool report) {
+    jobs$poll();
+
+    for (auto it = g_jobs.begin(); it != g_jobs.end();) {
+        auto& job = it->second;
+
+        if (report && !job.notified) {
+            job.notified = true;
+            std::cout << '[' << job.id << "] "
+                      << (job.state == JobState::Done ? "Done " : "Stopped ") << job.name
+                      << '\n';
+        }
+
+        if (job.state == JobState::Done)
+            it = g_jobs.erase(it);
+        else
+            it++;
+    }
+}
+
+void jobs$print() {
+    jobs$poll();
+
+    for (auto& [id, job] : g_jobs) {
+        auto state = "Running";
+
+        if (job.state == JobState::Stopped)
+            state = "Stopped";
+        else if (job.state == JobState::Done)
+            state = "Done";
+
+        std::cout << '[' << id << ']' << (&job == jobs$current() ? '+' : ' ') << ' ' << state
+                  << "\t\t" << job.name << '\n';
+
+        job.notified = true;
+    }
+}
+
+Job* jobs$current() { return g_jobs.size() ? &g_jobs.rbegin()->second : nullptr; }
+
+Job* jobs$find(std::string_view spec) {
+    // Accepts %n, %%, %+ and plain process ids.
+    if (spec == "%%" || spec == "%+" || spec == "%")
+        return jobs$current();
+
+    if (spec.size() && spec[0] == '%') {
+        auto id = atoi(std::string { spec.substr(1) }.c_str());
+        auto job = g_jobs.find(id);
+
+        return job != g_jobs.end() ? &job->second : nullptr;
+    }
+
+    auto pid = atoi(std::string { spec }.c_str());
+    auto entry = g_job_pids.find(pid);
+
+    return entry != g_job_pids.end() ? &g_jobs[entry->second] : nullptr;
+}
+
+bool jobs$continue(Job& job) {
+    auto ok = true;
+
+    if (g_job_control && job.pgid > 0) {
+        ok = kill(-job.pgid, SIGCONT) == 0;
+    } else {
+        for (auto i = size_t {}; i < job.pids.size(); i++)
+            if (job.status[i] < 0)
+                ok &= kill(job.pids[i], SIGCONT) == 0;
+    }
+
+    if (!ok)
+        perror("kill()");
+
+    job.state = JobState::Running;
+
+    return ok;
+}
+
+Job jobs$take(Job& job) {
+    // Removes job from the table so it can be waited on in the foreground.
+    auto taken = std::move(job);
+
+    for (auto pid : taken.pids)
+        g_job_pids.erase(pid);
+
+    g_jobs.erase(taken.id);
+
+    return taken;
+}
+
+size_t jobs$count() { return g_jobs.size(); }
+}
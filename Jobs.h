@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "Metrics.h"
+
+namespace BShell {
+struct Process {
+    pid_t pid;
+    std::string name;
+};
+
+enum class JobState { Running, Stopped, Done };
+
+struct Job {
+    int id;
+    pid_t pgid;             // 0 until the first process is added
+    std::string name;
+    std::vector<pid_t> pids;
+    std::vector<int> status; // exit status per process, -1 while it is still running
+    size_t live;
+    JobState state;
+    bool notified;
+    Timestamp start = metrics$now(); // a job is timed from its creation, $() in argv included
+    rusage usage;                    // of every process that exited so far
+};
+
+void jobs$init(bool);
+void jobs$subshell();
+pid_t jobs$pgroup(Job const&);
+void jobs$add(Job&, Process const&);
+int jobs$foreground(Job&);
+int jobs$background(Job&&);
+int jobs$wait(Job&, bool);
+void jobs$poll();
+void jobs$notify(bool = true);
+void jobs$print();
+Job* jobs$find(std::string_view);
+Job* jobs$current();
+bool jobs$continue(Job&);
+Job jobs$take(Job&);
+size_t jobs$count();
+
+extern bool g_job_control;
+}
@@ -0,0 +1,139 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Metrics.h"
+#include "Variables.h"
+
+namespace BShell {
+// The log is kept open for as long as BSHELL_METRICS names the same file.
+std::string g_metrics_path;
+int g_metrics_fd = -1;
+
+double timeval$seconds(timeval const& tv) { return tv.tv_sec + tv.tv_usec / 1e6; }
+
+Timestamp metrics$now() {
+    auto now = Timestamp {};
+
+    clock_gettime(CLOCK_REALTIME, &now.wall);
+    clock_gettime(CLOCK_MONOTONIC, &now.monotonic);
+
+    return now;
+}
+
+Metrics metrics$measure(std::string_view command, int status, Timestamp const& start,
+                        rusage const& usage) {
+    auto now = timespec {};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    auto real = (now.tv_sec - start.monotonic.tv_sec)
+        + (now.tv_nsec - start.monotonic.tv_nsec) / 1e9;
+
+    return Metrics { command,
+                     status,
+                     start.wall,
+                     real,
+                     timeval$seconds(usage.ru_utime),
+                     timeval$seconds(usage.ru_stime),
+                     usage.ru_maxrss };
+}
+
+void rusage$add(rusage& total, rusage const& usage) {
+    // Times add up over the processes of a pipeline, the peak is the largest one.
+    timeradd(&total.ru_utime, &usage.ru_utime, &total.ru_utime);
+    timeradd(&total.ru_stime, &usage.ru_stime, &total.ru_stime);
+
+    if (usage.ru_maxrss > total.ru_maxrss)
+        total.ru_maxrss = usage.ru_maxrss;
+}
+
+rusage rusage$diff(rusage const& after, rusage const& before) {
+    // Builtins run in the shell, they are charged what the shell spent meanwhile.
+    auto usage = after;
+
+    timersub(&after.ru_utime, &before.ru_utime, &usage.ru_utime);
+    timersub(&after.ru_stime, &before.ru_stime, &usage.ru_stime);
+
+    return usage;
+}
+
+void metrics$print(Metrics const& metrics) {
+    auto line = [](char const* name, double seconds) {
+        auto minutes = static_cast<int>(seconds / 60);
+
+        fprintf(stderr, "%s\t%dm%.3fs\n", name, minutes, seconds - minutes * 60);
+    };
+
+    fputc('\n', stderr);
+    line("real", metrics.real);
+    line("user", metrics.user);
+    line("sys", metrics.sys);
+    fprintf(stderr, "maxrss\t%ldk\n", metrics.maxrss);
+}
+
+void metrics$escape(std::string& out, std::string_view str) {
+    for (unsigned char c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+}
+
+bool metrics$enabled() {
+    // BSHELL_METRICS=path appends one JSON object per command to path.
+    auto* path = var$get("BSHELL_METRICS");
+
+    return path && *path;
+}
+
+void metrics$log(Metrics const& metrics) {
+    if (!metrics$enabled())
+        return;
+
+    auto* path = var$get("BSHELL_METRICS");
+
+    if (g_metrics_fd < 0 || g_metrics_path != path) {
+        if (g_metrics_fd >= 0)
+            close(g_metrics_fd);
+
+        g_metrics_path = path;
+        g_metrics_fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+        if (g_metrics_fd < 0) {
+            perror(path);
+            return;
+        }
+    }
+
+    auto line = std::string { "{\"command\":\"" };
+    char buf[256];
+
+    metrics$escape(line, metrics.command);
+    snprintf(buf, sizeof(buf),
+             "\",\"status\":%d,\"start\":%ld.%06ld,\"real\":%.6f,\"user\":%.6f,\"sys\":%.6f,"
+             "\"maxrss\":%ld,\"pid\":%d}\n",
+             metrics.status, static_cast<long>(metrics.start.tv_sec),
+             metrics.start.tv_nsec / 1000, metrics.real, metrics.user, metrics.sys,
+             metrics.maxrss, getpid());
+    line += buf;
+
+    // One write per line, so shells sharing the file never interleave within a line.
+    if (write(g_metrics_fd, line.data(), line.size()) < 0)
+        perror("write()");
+}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string_view>
+
+#include <sys/resource.h>
+#include <time.h>
+
+namespace BShell {
+// When a command started. Its duration is measured on the monotonic clock, so stepping
+// the system time does not change it, the wall clock is only what the log shows.
+struct Timestamp {
+    timespec wall, monotonic;
+};
+
+// What one command cost, for `time` and the BSHELL_METRICS log.
+struct Metrics {
+    std::string_view command;
+    int status;
+    timespec start; // wall clock
+    double real, user, sys; // seconds
+    long maxrss;            // KiB, the largest process of the command
+};
+
+Timestamp metrics$now();
+Metrics metrics$measure(std::string_view, int, Timestamp const&, rusage const&);
+void rusage$add(rusage&, rusage const&);
+rusage rusage$diff(rusage const&, rusage const&);
+void metrics$print(Metrics const&);
+bool metrics$enabled();
+void metrics$log(Metrics const&);
+}
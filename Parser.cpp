@@ -1,10 +1,17 @@
+#include <algorithm>
+#include <cctype>
 #include <iostream>
-#include <memory>
+#include <span>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "Glob.h"
 #include "Parser.h"
 #include "Tokenizer.h"
+#include "Trace.h"
+#include "Variables.h"
 
 #define PARSER_ERR(msg)           \
     {                             \
@@ -13,83 +20,508 @@
     }
 
 namespace BShell {
-Expression::Expression() { }
-Expression::Expression(Token token)
-    : token(token) { }
+Expression::Iterator::Iterator(Ast const* ast, uint32_t index)
+    : m_ast(ast)
+    , m_index(index) { }
 
-Parser::Parser(std::vector<Token>&& tokens)
-    : m_tokens(tokens)
+Expression Expression::Iterator::operator*() const { return Expression { m_ast, m_index }; }
+
+Expression::Iterator& Expression::Iterator::operator++() {
+    m_index = (*m_ast)[m_index].next;
+    return *this;
+}
+
+Expression::Expression(Ast const* ast, uint32_t index)
+    : m_ast(ast)
+    , m_index(index) { }
+
+ExpressionNode const& Expression::node() const { return (*m_ast)[m_index]; }
+
+TokenType Expression::type() const { return node().type; }
+
+uint16_t Expression::flags() const { return node().flags; }
+
+std::string_view Expression::content() const { return m_ast->text(node()); }
+
+Token Expression::token() const { return Token { type(), std::string { content() } }; }
+
+Expression::Children Expression::children() const {
+    return Children { Iterator { m_ast, node().first }, Iterator { m_ast, NoExpression } };
+}
+
+size_t Expression::size() const { return node().count; }
+
+Expression Expression::child(size_t n) const {
+    auto index = node().first;
+
+    while (n--)
+        index = (*m_ast)[index].next;
+
+    return Expression { m_ast, index };
+}
+
+Expression Expression::front() const { return Expression { m_ast, node().first }; }
+
+Expression Expression::back() const { return Expression { m_ast, node().last }; }
+
+Ast::Ast(std::string_view text)
+    : m_text(text)
+    , m_nodes()
+    , m_roots() { }
+
+Ast::Ast(std::string_view text, std::span<ExpressionNode const> nodes,
+         std::span<uint32_t const> roots)
+    : m_text(text)
+    , m_nodes(nodes.begin(), nodes.end())
+    , m_roots(roots.begin(), roots.end()) { }
+
+uint32_t Ast::add(TokenType type, uint32_t offset, uint32_t length) {
+    m_nodes.push_back(ExpressionNode {
+        type, 0, offset, length, NoExpression, NoExpression, NoExpression, 0 });
+
+    return m_nodes.size() - 1;
+}
+
+uint32_t Ast::add(TokenType type, std::string_view content) {
+    // Text that is not already part of the line is appended to the pool.
+    auto offset = static_cast<uint32_t>(m_text.size());
+
+    m_text += content;
+
+    return add(type, offset, static_cast<uint32_t>(content.size()));
+}
+
+void Ast::adopt(uint32_t parent, uint32_t child) {
+    auto& node = m_nodes[parent];
+
+    if (node.last == NoExpression)
+        node.first = child;
+    else
+        m_nodes[node.last].next = child;
+
+    node.last = child;
+    node.count++;
+}
+
+std::string_view Ast::text(ExpressionNode const& node) const {
+    return std::string_view { m_text }.substr(node.offset, node.length);
+}
+
+Parser::Parser(Tokenizer const& tokenizer)
+    : m_err()
     , m_cur()
     , m_next()
-    , m_asts()
-    , m_err() {
+    , m_ast(tokenizer.input())
+    , m_asts(m_ast.m_roots)
+    , m_base()
+    , m_tokens(tokenizer.spans()) {
+    TRACE_SCOPE("parse");
+
+    m_ast.m_nodes.reserve(m_tokens.size());
+    m_ast.m_text += tokenizer.aliased();
+
     parse();
 }
 
-std::vector<std::shared_ptr<Expression>> Parser::asts() const {
-    return m_err ? std::vector<std::shared_ptr<Expression>> {} : m_asts;
+Ast Parser::ast() && {
+    if (m_err)
+        m_asts.clear();
+
+    return std::move(m_ast);
+}
+
+uint32_t Parser::add(TokenSpan const& token) {
+    // The line itself is the start of the text pool, so tokens are referenced in place.
+    return m_ast.add(token.type, token.offset, token.length);
 }
 
-std::shared_ptr<Expression> Parser::glue_sticky() {
-    auto expr = std::shared_ptr<Expression> {};
+uint32_t Parser::add_word(std::span<TokenSpan const* const> pieces, TokenType type) {
+    // A word of one or more glued tokens. A word with unquoted pattern characters or
+    // parameters outside single quotes is expanded when it runs, its text is then
+    // escaped (see Glob) so the parts that were quoted only stand for themselves.
+    auto& text = m_ast.m_text;
+    auto scan = [&](TokenSpan const* token) {
+        // A single pass over the token itself, the text pool goes on to the end of the line.
+        uint16_t found = 0;
+
+        for (auto c : std::string_view { text }.substr(token->offset, token->length)) {
+            switch (c) {
+            case '*':
+            case '?':
+            case '[':
+                found |= Wildcard;
+                break;
+            case '$':
+                found |= Expand;
+                break;
+            default:
+                break;
+            }
+        }
+
+        return found;
+    };
+
+    auto wildcard = false;
+    auto expand = false;
+
+    for (auto const* token : pieces) {
+        if (token->quote == '\'')
+            continue;
+
+        auto found = scan(token);
+        wildcard |= !token->quote && (found & Wildcard);
+        expand |= (found & Expand) != 0;
+    }
+
+    if (pieces.size() == 1 && !wildcard && !expand)
+        return add(*pieces[0]);
+
+    // Glued strings are appended to the end of the text pool.
+    auto offset = text.size();
+
+    for (auto const* token : pieces) {
+        auto special = std::string {};
+
+        if (wildcard && token->quote)
+            special += "*?[";
+
+        if (expand && token->quote == '\'')
+            special += '$';
+
+        // A parameter name ends with its piece, "$HOME"x is $HOME followed by x.
+        if (expand && token != pieces[0] && token->length
+            && (std::isalnum(static_cast<unsigned char>(text[token->offset]))
+                || text[token->offset] == '_'))
+            text += '\\';
+
+        if (wildcard || expand)
+            text += glob$escape(std::string_view { text }.substr(token->offset, token->length),
+                                special);
+        else
+            text.append(text, token->offset, token->length);
+    }
+
+    auto expr = m_ast.add(type, offset, text.size() - offset);
+
+    m_ast[expr].flags |= (wildcard ? Wildcard : 0) | (expand ? Expand : 0);
+
+    return expr;
+}
+
+uint32_t Parser::glue_sticky() {
+    TokenSpan const* pieces[3];
+    auto count = size_t {};
+
+    auto glue = [&](TokenSpan const* token) { pieces[count++] = token; };
 
     if (!peek())
-        return nullptr;
+        return NoExpression;
 
     if (m_cur->type == StickyRight && peek()->type & (String | StickyLeft)) {
-        expr = std::make_shared<Expression>(Token {
-            String,
-            m_cur->content + peek()->content });
+        glue(m_cur);
+        glue(peek());
 
         m_cur++;
     }
 
-    if (m_cur->type == String && peek()->type == StickyLeft) {
-        if (expr)
-            expr->token.content += peek()->content;
-        else
-            expr = std::make_shared<Expression>(Token {
-                String,
-                m_cur->content + peek()->content });
+    if (m_cur->type == String && peek() && peek()->type == StickyLeft) {
+        if (!count)
+            glue(m_cur);
+
+        glue(peek());
 
         m_cur++;
     }
 
-    return expr;
+    if (!count)
+        return NoExpression;
+
+    return add_word(std::span { pieces, count }, String);
+}
+
+uint32_t Parser::add_word() {
+    // The word starting at m_cur, which is left on the last token of it.
+    auto glue = glue_sticky();
+
+    if (glue != NoExpression)
+        return glue;
+
+    return m_cur->type == Eval ? add(*m_cur) : add_word({ &m_cur, 1 }, m_cur->type);
 }
 
-void Parser::add_strings(std::shared_ptr<Expression> const& expr) {
+void Parser::add_strings(uint32_t expr) {
     while ((m_next = peek()) != nullptr) {
         if (!(m_next->type & (StickyRight | StickyLeft | String | Eval)))
             break;
 
         m_cur++;
+        m_ast.adopt(expr, add_word());
+    }
+}
 
-        auto glue = glue_sticky();
+uint32_t Parser::operand(TokenType op) const {
+    // The command an operator applies to. `;` and newlines bind loosest, then `&` and
+    // `&&`, then `|`, then redirections, so in `a; b | c` the pipe takes b and not the
+    // list before it.
+    auto binding = [](TokenType type) {
+        switch (type) {
+        case Sequential:
+            return 1;
+        case Background:
+        case SequentialIf:
+            return 2;
+        case RedirectPipe:
+            return 3;
+        default:
+            return 4;
+        }
+    };
 
-        expr->children.push_back(glue ? glue : std::make_shared<Expression>(*m_next));
-    }
+    auto expr = m_asts.back();
+
+    while (binding(m_ast[expr].type) < binding(op))
+        expr = m_ast[expr].last;
+
+    return expr;
 }
 
-void Parser::parse_background() {
-    auto expr = std::shared_ptr<Expression> {};
+void Parser::wrap(uint32_t expr) {
+    // The operator at m_cur takes the place of expr, which becomes its first child. The
+    // node is changed in place, so a list that ended in expr now ends in the operator.
+    auto node = m_ast[expr];
+    auto command = static_cast<uint32_t>(m_ast.size());
+
+    m_ast.m_nodes.push_back(node);
+    m_ast[command].next = NoExpression;
+    m_ast[expr] = ExpressionNode { m_cur->type, 0, m_cur->offset, m_cur->length,
+                                   NoExpression, NoExpression, node.next, 0 };
+    m_ast.adopt(expr, command);
+}
 
-    if (!m_asts.size() || m_asts.back()->token.type != Executable)
+void Parser::parse_background() {
+    if (m_asts.size() <= m_base
+        || !(m_ast[operand(Background)].type & (Executable | Key | Function))) {
         PARSER_ERR("Syntax error near unexpected token '&'.");
+        return;
+    }
+
+    wrap(operand(Background));
+}
+
+void Parser::parse_time() {
+    // `time` is not a command of its own, it marks the command after it. When that
+    // command starts a pipeline, parse_sequential moves the mark to the pipeline.
+    if (m_next == nullptr || !(m_next->type & (Executable | Key | Function))) {
+        PARSER_ERR("Syntax error near unexpected token 'time'.");
+        return;
+    }
+
+    m_cur++;
+    m_next = peek();
+    parse_current();
+
+    if (!m_err && m_ast[m_asts.back()].type == Compound)
+        PARSER_ERR("Syntax error, compound commands cannot be timed.")
+    else if (!m_err)
+        m_ast[m_asts.back()].flags |= Timed;
+}
+
+uint32_t Parser::parse_list(std::initializer_list<std::string_view> terminators) {
+    // The commands up to one of the terminators, wrapped into one Sequential node that
+    // may well be empty. m_cur is left on the terminator.
+    auto const* end = m_tokens.data() + m_tokens.size();
+    auto base = std::exchange(m_base, m_asts.size());
+    auto list = m_ast.add(Sequential, 0, 0);
+
+    while (m_cur < end && !at(terminators)) {
+        m_next = peek();
+        parse_current();
+
+        if (m_err)
+            break;
+
+        m_cur++;
+    }
+
+    if (!m_err && m_cur == end)
+        PARSER_ERR("Syntax error, expected '" << *terminators.begin() << "'.")
+
+    for (auto i = m_base; i < m_asts.size(); i++)
+        m_ast.adopt(list, m_asts[i]);
+
+    m_asts.resize(m_base);
+    m_base = base;
+
+    return list;
+}
+
+void Parser::parse_compound() {
+    // if:          [condition, list, (condition, list)..., else list]
+    // while/until: [condition, list]
+    // for:         [name, "in" with the words as children, list]
+    // case:        [word, ")" item...], an item is [pattern..., list]
+    // {:           [list]
+    // > or <:      [compound command, redirection...], see parse_redirection
+    auto word = text(*m_cur);
+    auto expr = add(*m_cur);
+
+    m_ast[expr].type = Compound;
 
-    expr = std::make_shared<Expression>(*m_cur);
+    auto condition = [&](std::string_view terminator) {
+        m_cur++;
+
+        auto list = parse_list({ terminator });
+
+        if (!m_err && !m_ast[list].count)
+            PARSER_ERR("Syntax error near unexpected token '" << terminator << "'.")
+
+        m_ast.adopt(expr, list);
+        m_cur += !m_err;
+    };
+
+    if (word == "for") {
+        parse_for(expr);
+    } else if (word == "case") {
+        parse_case(expr);
+    } else if (word == "{") {
+        m_cur++;
+        m_ast.adopt(expr, parse_list({ "}" }));
+    } else if (word == "if") {
+        do {
+            condition("then");
+
+            if (!m_err)
+                m_ast.adopt(expr, parse_list({ "fi", "elif", "else" }));
+        } while (!m_err && text(*m_cur) == "elif");
+
+        if (!m_err && text(*m_cur) == "else") {
+            m_cur++;
+            m_ast.adopt(expr, parse_list({ "fi" }));
+        }
+    } else {
+        condition("do");
 
-    expr.get()->children.push_back(m_asts.back());
+        if (!m_err)
+            m_ast.adopt(expr, parse_list({ "done" }));
+    }
 
-    m_asts.pop_back();
-    m_asts.push_back(expr);
+    if (!m_err)
+        m_asts.push_back(expr);
+}
+
+void Parser::parse_for(uint32_t expr) {
+    auto const* end = m_tokens.data() + m_tokens.size();
+
+    if (++m_cur == end || m_cur->type != String || !var$valid(text(*m_cur))) {
+        PARSER_ERR("Syntax error, expected a name after 'for'.")
+        return;
+    }
+
+    m_ast.adopt(expr, add(*m_cur));
+
+    // Without `in` the loop goes over the arguments of the function it is in.
+    auto in = peek() && peek()->type == String && text(*peek()) == "in";
+    auto words = in ? add(*++m_cur) : m_ast.add(String, m_cur->offset, 0);
+
+    if (in)
+        add_strings(words);
+
+    m_ast.adopt(expr, words);
+
+    m_cur++;
+    skip_separators();
+
+    if (!at({ "do" })) {
+        PARSER_ERR("Syntax error, expected 'do'.")
+        return;
+    }
+
+    m_cur++;
+    m_ast.adopt(expr, parse_list({ "done" }));
+}
+
+void Parser::parse_case(uint32_t expr) {
+    auto const* end = m_tokens.data() + m_tokens.size();
+    auto word = StickyRight | StickyLeft | String;
+
+    if (++m_cur == end || !(m_cur->type & (word | Eval))) {
+        PARSER_ERR("Syntax error, expected a word after 'case'.")
+        return;
+    }
+
+    m_ast.adopt(expr, add_word());
+
+    if (++m_cur == end || m_cur->type != String || text(*m_cur) != "in") {
+        PARSER_ERR("Syntax error, expected 'in'.")
+        return;
+    }
+
+    m_cur++;
+    skip_separators();
+
+    while (!at({ "esac" })) {
+        auto item = m_ast.add(Compound, ")");
+
+        // Patterns are separated by '|', the last one ends in ')'. A ')' may also
+        // stand on its own, and the first pattern may start with '('.
+        for (auto close = false; !close;) {
+            if (m_cur == end || !(m_cur->type & word)) {
+                PARSER_ERR("Syntax error, expected a pattern or 'esac'.")
+                return;
+            }
+
+            auto pattern = add_word();
+            auto& node = m_ast[pattern];
+
+            close = m_ast.text(node).ends_with(')');
+            node.length -= close;
+
+            if (!m_ast[item].count && m_ast.text(node).starts_with('(')) {
+                node.offset++;
+                node.length--;
+            }
+
+            if (node.length || !close || !m_ast[item].count)
+                m_ast.adopt(item, pattern);
+
+            if (++m_cur < end && m_cur->type == RedirectPipe && !close)
+                m_cur++;
+        }
+
+        m_ast.adopt(item, parse_list({ "esac", ";;" }));
+        m_ast.adopt(expr, item);
+
+        if (m_err)
+            return;
+
+        if (at({ ";;" })) {
+            m_cur += 2;
+            skip_separators();
+        }
+    }
 }
 
 void Parser::parse_current() {
     switch (m_cur->type) {
-    case Key:
+    case Key: {
+        auto word = text(*m_cur);
+
+        if (word == "time")
+            return parse_time();
+
+        if (keyword$nesting(word) > 0)
+            return parse_compound();
+
+        if (keyword$closes(word)) {
+            PARSER_ERR("Syntax error near unexpected token '" << word << "'.")
+            return;
+        }
+    }
+        [[fallthrough]];
+    case Function:
     case Executable: {
-        auto expr = std::make_shared<Expression>(*m_cur);
+        auto expr = add(*m_cur);
 
         add_strings(expr);
         m_asts.push_back(expr);
@@ -110,83 +542,157 @@ void Parser::parse_current() {
         parse_background();
         break;
     case String:
+        // `name() compound-command` defines a function.
+        if (text(*m_cur).ends_with("()") && m_cur->length > 2 && m_next && m_next->type == Key
+            && keyword$nesting(text(*m_next)) > 0)
+            return parse_function();
+
+        // Any other word in command position that is not an assignment is a call, of a
+        // function the tokenizer did not know about yet or of a command.
+        if (!m_next || m_next->type != Equal) {
+            auto expr = add(*m_cur);
+
+            m_ast[expr].type = Function;
+            add_strings(expr);
+            m_asts.push_back(expr);
+            break;
+        }
+
+        [[fallthrough]];
     case StickyRight:
     case StickyLeft:
-        m_asts.push_back(std::make_shared<Expression>(*m_cur));
+        m_asts.push_back(add(*m_cur));
+        break;
+    default:
         break;
     }
 }
 
+void Parser::parse_function() {
+    // A Compound "()" node of [name, body], the body is the compound command itself.
+    auto expr = m_ast.add(Compound, "()");
+
+    m_ast.adopt(expr, m_ast.add(String, m_cur->offset, m_cur->length - 2));
+    m_cur++;
+    parse_compound();
+
+    if (m_err)
+        return;
+
+    m_ast.adopt(expr, m_asts.back());
+    m_asts.back() = expr;
+}
+
+bool Parser::redirected(uint32_t expr) const {
+    // A compound command with redirections, see parse_redirection.
+    auto word = m_ast.text(m_ast[expr]);
+
+    return m_ast[expr].type == Compound && (word == ">" || word == "<");
+}
+
 void Parser::parse_redirection() {
-    // Redirections should always be the child of an executable.
-    if (m_asts.size() && (m_asts.back()->token.type & (RedirectPipe | Executable))) {
+    // Redirections should always be the child of an executable, or of the Compound node
+    // a compound command is wrapped into by its first one: [command, redirection...].
+    // Those of a function definition apply to its body, on every call.
+    auto commands = Executable | Key | Function | Compound;
+
+    if (m_asts.size() > m_base && (m_ast[operand(m_cur->type)].type & commands)) {
         if (m_next == nullptr || !(m_next->type & (Eval | String | StickyLeft))) {
             // Should probably make a lookup for the token's corresponding char
             PARSER_ERR("Syntax error at unexpected redirection token.");
             return;
         }
 
-        auto expr = std::make_shared<Expression>(*m_cur);
-        auto exec = std::shared_ptr<Expression> {};
+        auto expr = add(*m_cur);
+        auto exec = operand(m_cur->type);
 
-        if (m_asts.back()->token.type == RedirectPipe)
-            exec = m_asts.back()->children.back();
-        else
-            exec = m_asts.back();
+        if (m_ast[exec].type == Compound && m_ast.text(m_ast[exec]) == "()")
+            exec = m_ast[exec].last;
 
-        expr->children.push_back(std::make_shared<Expression>(*++m_cur));
-        exec->children.push_back(expr);
+        if (m_ast[exec].type == Compound && !redirected(exec)) {
+            wrap(exec);
+            m_ast[exec].type = Compound;
+        }
+
+        m_cur++;
+        m_ast.adopt(expr, m_cur->type == Eval ? add(*m_cur) : add_word({ &m_cur, 1 }, m_cur->type));
+        m_ast.adopt(exec, expr);
     } else {
         PARSER_ERR("Syntax error near unexpected redirection token.");
     }
 }
 
 void Parser::parse_sequential() {
+    auto const* end = m_tokens.data() + m_tokens.size();
     auto type = m_cur->type;
 
-    if (m_asts.size() && m_asts.back()->token.type != String) {
-        if (m_next == nullptr || !(m_next->type & (Executable | Key))) {
+    // A `;` or newline with nothing after it in its list only ends the command before
+    // it, and blank lines separate nothing at all.
+    if (type == Sequential) {
+        auto closes = m_next && m_next->type == Key && keyword$closes(text(*m_next));
+
+        if (m_asts.size() <= m_base ? text(*m_cur) == "\n"
+                                    : !m_next || m_next->type == Sequential || closes)
+            return;
+    }
+
+    // An assignment may follow a `;` or newline, `x=1; y=2`.
+    auto assignment = type == Sequential && m_next && m_next->type == String && m_next + 1 < end
+        && m_next[1].type == Equal;
+
+    if (m_asts.size() > m_base && m_ast[m_asts.back()].type != String) {
+        if (m_next == nullptr || !(m_next->type & (Executable | Key | Function | String))) {
             // We do not currently support a continuation prompt
             PARSER_ERR("Syntax error at unexpected token '|'.");
             return;
         }
 
-        auto expr = std::shared_ptr<Expression> {};
+        auto expr = operand(type);
 
         // Instead of having a multi-level tree for all the pipes
         // flatten the tree into one layer, where children from
         // left have higher precedence when executing.
 
-        if (m_asts.back()->token.type == type) {
-            expr = m_asts.back();
-        } else {
-            expr = std::make_shared<Expression>(*m_cur);
-            expr->children.push_back(m_asts.back());
-        }
+        if (m_ast[expr].type != type) {
+            wrap(expr);
 
-        m_asts.pop_back();
+            // `time` covers the whole pipeline its first command starts.
+            if (type == RedirectPipe) {
+                m_ast[expr].flags = m_ast[m_ast[expr].first].flags & Timed;
+                m_ast[m_ast[expr].first].flags &= ~Timed;
+            }
+        }
 
         m_cur++;
+        m_next = peek();
         parse_current();
 
-        expr->children.push_back(m_asts.back());
-        m_asts.pop_back();
+        if (assignment) {
+            m_cur++;
+            m_next = peek();
+            parse_equal();
+        }
 
-        m_asts.push_back(expr);
+        if (m_err)
+            return;
+
+        m_ast.adopt(expr, m_asts.back());
+        m_asts.pop_back();
     } else
         PARSER_ERR("Syntax error near unexpected token '|'.");
 }
 
 void Parser::parse_equal() {
-    if (m_asts.size() && m_asts.back()->token.type & (String | StickyRight | StickyLeft)) {
-        if (m_next == nullptr || !(m_next->type & (String | StickyRight | StickyLeft))) {
+    if (m_asts.size() > m_base && m_ast[m_asts.back()].type & (String | StickyRight | StickyLeft)) {
+        if (m_next == nullptr || !(m_next->type & (String | StickyRight | StickyLeft | Eval))) {
             PARSER_ERR("Syntax error new unexpected token '='.")
             return;
         }
 
-        auto expr = std::make_shared<Expression>(*m_cur);
-        expr->children.push_back(m_asts.back());
-        expr->children.push_back(std::make_shared<Expression>(*++m_cur));
+        auto expr = add(*m_cur);
+        m_ast.adopt(expr, m_asts.back());
+        m_cur++;
+        m_ast.adopt(expr, m_cur->type == Eval ? add(*m_cur) : add_word({ &m_cur, 1 }, m_cur->type));
 
         m_asts.pop_back();
         m_asts.push_back(expr);
@@ -198,39 +704,63 @@ void Parser::parse() {
     if (!m_tokens.size())
         return;
 
-    m_cur = &*m_tokens.begin();
-
-    while (m_cur < &*m_tokens.end()) {
-        if (m_err)
-            return;
+    m_cur = m_tokens.data();
 
+    while (m_cur < m_tokens.data() + m_tokens.size()) {
         m_next = peek();
 
         parse_current();
 
+        if (m_err)
+            return;
+
         m_cur++;
     }
 }
 
-Token* Parser::peek() const {
-    if (&*m_tokens.end() != m_cur + 1)
+TokenSpan const* Parser::peek() const {
+    if (m_tokens.data() + m_tokens.size() != m_cur + 1)
         return m_cur + 1;
 
     return nullptr;
 }
 
-void ast$print(std::shared_ptr<Expression> expr, int depth) {
+std::string_view Parser::text(TokenSpan const& token) const {
+    return std::string_view { m_ast.m_text }.substr(token.offset, token.length);
+}
+
+bool Parser::at(std::initializer_list<std::string_view> words) const {
+    // Whether m_cur is one of the reserved words, or the `;;` that ends a case item.
+    if (m_cur == m_tokens.data() + m_tokens.size())
+        return false;
+
+    for (auto word : words) {
+        if (word != ";;" ? m_cur->type == Key && text(*m_cur) == word
+                         : m_cur->type == Sequential && text(*m_cur) == ";" && peek()
+                             && peek()->type == Sequential && text(*peek()) == ";"
+                             && peek()->offset == m_cur->offset + 1)
+            return true;
+    }
+
+    return false;
+}
+
+void Parser::skip_separators() {
+    while (m_cur < m_tokens.data() + m_tokens.size() && m_cur->type == Sequential && !at({ ";;" }))
+        m_cur++;
+}
+
+void ast$print(Expression const& expr, int depth) {
     for (auto i = 0; i < depth; i++)
         std::cout << "    ";
 
-    std::cout << expr->token << '\n';
+    std::cout << expr.token() << '\n';
 
-    if (expr->children.size())
-        for (auto i = 0; i < expr->children.size(); i++)
-            ast$print(expr->children[i], depth + 1);
+    for (auto const& child : expr.children())
+        ast$print(child, depth + 1);
 }
 
-void ast$print(std::shared_ptr<Expression> expr) {
+void ast$print(Expression const& expr) {
     ast$print(expr, 0);
 }
 }
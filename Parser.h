@@ -1,43 +1,153 @@
 #pragma once
 
-#include <memory>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include "Tokenizer.h"
 
 namespace BShell {
-struct Expression {
-    Expression();
-    Expression(Token);
+constexpr uint32_t NoExpression = UINT32_MAX;
 
-    std::vector<std::shared_ptr<Expression>> children;
-    Token token;
+// Modifiers the parser attaches to a node instead of wrapping it.
+enum NodeFlag : uint16_t {
+    Timed = 1,    // prefixed by `time`
+    Wildcard = 2, // an argument to expand as a pathname pattern, its text is the pattern
+    Expand = 4,   // a word with parameters to expand, its text is escaped like a pattern
+};
+
+// Nodes are stored flat inside their Ast, children are a singly linked list of node indices.
+struct ExpressionNode {
+    TokenType type;
+    uint16_t flags;
+    uint32_t offset, length;      // content within the Ast's text
+    uint32_t first, last, next;   // first child, last child and next sibling
+    uint32_t count;               // number of children
+};
+
+class Ast;
+
+// A cheap reference to a node, only valid as long as the Ast it points into.
+class Expression {
+public:
+    class Iterator {
+    public:
+        Iterator(Ast const*, uint32_t);
+
+        Expression operator*() const;
+        Iterator& operator++();
+        bool operator==(Iterator const&) const = default;
+
+    private:
+        Ast const* m_ast;
+        uint32_t m_index;
+    };
+
+    struct Children {
+        Iterator begin() const { return m_begin; }
+        Iterator end() const { return m_end; }
+
+        Iterator m_begin, m_end;
+    };
+
+    Expression(Ast const*, uint32_t);
+
+    TokenType type() const;
+    uint16_t flags() const;
+    std::string_view content() const;
+    Token token() const;
+
+    Children children() const;
+    size_t size() const;
+    Expression child(size_t) const;
+    Expression front() const;
+    Expression back() const;
+
+    uint32_t index() const { return m_index; }
+    Ast const& ast() const { return *m_ast; }
+
+    bool operator==(Expression const&) const = default;
+
+private:
+    ExpressionNode const& node() const;
+
+    Ast const* m_ast;
+    uint32_t m_index;
+};
+
+// Owns every node and every byte of text of one parsed line, freed in one shot.
+class Ast {
+public:
+    Ast() = default;
+    Ast(std::string_view);
+    // Rebuilds an Ast from the pieces of one that was serialized.
+    Ast(std::string_view, std::span<ExpressionNode const>, std::span<uint32_t const>);
+
+    uint32_t add(TokenType, uint32_t, uint32_t);
+    uint32_t add(TokenType, std::string_view);
+    void adopt(uint32_t, uint32_t);
+
+    ExpressionNode& operator[](uint32_t index) { return m_nodes[index]; }
+    ExpressionNode const& operator[](uint32_t index) const { return m_nodes[index]; }
+
+    std::string_view text(ExpressionNode const&) const;
+    Expression at(uint32_t index) const { return Expression { this, index }; }
+    std::span<uint32_t const> roots() const { return m_roots; }
+    std::span<ExpressionNode const> nodes() const { return m_nodes; }
+    std::string_view text() const { return m_text; }
+    size_t size() const { return m_nodes.size(); }
+
+private:
+    friend class Parser;
+
+    std::string m_text;
+    std::vector<ExpressionNode> m_nodes;
+    std::vector<uint32_t> m_roots;
 };
 
 class Parser {
 public:
-    Parser(std::vector<Token>&&);
-    std::vector<std::shared_ptr<Expression>> asts() const;
+    Parser(Tokenizer const&);
+    Ast ast() &&;
 
 private:
     void parse();
-    void add_strings(std::shared_ptr<Expression> const&);
+    void add_strings(uint32_t);
     void parse_background();
     void parse_sequential();
     void parse_redirection();
     void parse_current();
     void parse_equal();
+    void parse_time();
+    void parse_compound();
+    void parse_function();
+    void parse_for(uint32_t);
+    void parse_case(uint32_t);
+    uint32_t parse_list(std::initializer_list<std::string_view>);
+    uint32_t operand(TokenType) const;
+    void wrap(uint32_t);
+    bool redirected(uint32_t) const;
 
-    std::shared_ptr<Expression> glue_sticky();
+    uint32_t add(TokenSpan const&);
+    uint32_t add_word(std::span<TokenSpan const* const>, TokenType);
+    uint32_t glue_sticky();
+    uint32_t add_word();
 
-    Token* peek() const;
+    TokenSpan const* peek() const;
+    std::string_view text(TokenSpan const&) const;
+    bool at(std::initializer_list<std::string_view>) const;
+    void skip_separators();
 
     bool m_err;
-    Token *m_cur, *m_next;
+    TokenSpan const *m_cur, *m_next;
 
-    std::vector<std::shared_ptr<Expression>> m_asts;
-    std::vector<Token>& m_tokens;
+    Ast m_ast;
+    std::vector<uint32_t>& m_asts;
+    size_t m_base; // where the roots of the list being parsed start
+    std::span<TokenSpan const> m_tokens;
 };
 
-void ast$print(std::shared_ptr<Expression>);
+void ast$print(Expression const&);
 }
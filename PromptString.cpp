@@ -1,6 +1,10 @@
 #include <string>
+#include <vector>
+
+#include <time.h>
 
 #include "Interpreter.h"
+#include "Jobs.h"
 #include "PromptString.h"
 #include "System.h"
 
@@ -9,46 +13,146 @@ using namespace BShell;
 namespace BShell {
 std::string PS1 = "[B] \\u@\\h \\w\\$ ";
 
-std::string parse$PS_format_string(char const& c) {
-    switch (c) {
-    case 'u':
-        return get$username();
-    case 'h':
-        return get$hostname();
-    case '$':
-        return get$username() == "root" ? "#" : "$";
-    case 'w': {
-        auto cwd = get$cwd();
-
-        if (cwd == "/")
-            return cwd;
-        else if (cwd == get$home())
-            return "~";
-
-        return cwd.substr(cwd.find_last_of('/') + 1);
-    }
-    default:
-        return "";
-    }
+// PS1 is compiled into segments when it changes; user and host are looked up once
+// and the working directory only again after a cd.
+struct CompiledPrompt {
+    std::string source;
+    std::vector<PromptSegment> segments;
+    size_t cwd_generation;
+    std::string cwd;
+    std::string rendered;
+};
+
+CompiledPrompt g_prompt = { {}, {}, SIZE_MAX };
+
+std::string const& prompt$username() {
+    static auto const username = get$username();
+    return username;
+}
+
+std::string const& prompt$hostname() {
+    static auto const hostname = get$hostname();
+    return hostname;
 }
 
-std::string parse$PS(std::string const& PS) {
-    auto parsed = std::string {};
+std::vector<PromptSegment> parse$PS(std::string const& PS) {
+    auto segments = std::vector<PromptSegment> {};
     auto gobble = false;
 
+    auto text = [&]() -> std::string& {
+        if (segments.empty() || segments.back().part != PromptPart::Text)
+            segments.push_back(PromptSegment { PromptPart::Text });
+
+        return segments.back().text;
+    };
+
+    auto part = [&](PromptPart part) { segments.push_back(PromptSegment { part }); };
+
     for (auto const& c : PS) {
-        if (gobble) {
-            parsed += parse$PS_format_string(c);
-            gobble = false;
-        } else if (c == '\\') {
-            gobble = true;
-        } else {
-            parsed += c;
+        if (!gobble) {
+            if (c == '\\')
+                gobble = true;
+            else
+                text() += c;
+
+            continue;
+        }
+
+        gobble = false;
+
+        switch (c) {
+        case 'u':
+            text() += prompt$username();
+            break;
+        case 'h':
+            text() += prompt$hostname();
+            break;
+        case '$':
+            text() += prompt$username() == "root" ? "#" : "$";
+            break;
+        case '\\':
+            text() += '\\';
+            break;
+        case 'w':
+            part(PromptPart::Cwd);
+            break;
+        case 't':
+            part(PromptPart::Time);
+            break;
+        case '?':
+            part(PromptPart::Status);
+            break;
+        case 'j':
+            part(PromptPart::Jobs);
+            break;
         }
     }
 
-    return parsed;
+    return segments;
 }
 
-std::string const get$PS1() { return parse$PS(PS1); }
+std::string prompt$cwd() {
+    auto cwd = get$cwd();
+
+    if (cwd == "/")
+        return cwd;
+    else if (cwd == get$home())
+        return "~";
+
+    return cwd.substr(cwd.find_last_of('/') + 1);
+}
+
+void prompt$time(std::string& out) {
+    // CLOCK_REALTIME is served by the vDSO and the zone was loaded by the first call,
+    // so this does not enter the kernel.
+    auto now = timespec {};
+    auto local = tm {};
+    char buf[16];
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&now.tv_sec, &local);
+
+    out.append(buf, strftime(buf, sizeof(buf), "%H:%M:%S", &local));
+}
+
+void set$PS1(std::string PS) {
+    PS1 = std::move(PS);
+    g_prompt.segments = parse$PS(PS1);
+    g_prompt.source = PS1;
+}
+
+std::string const& get$PS1() {
+    if (g_prompt.source != PS1 || g_prompt.segments.empty())
+        set$PS1(PS1);
+
+    auto& out = g_prompt.rendered;
+    out.clear();
+
+    for (auto const& segment : g_prompt.segments) {
+        switch (segment.part) {
+        case PromptPart::Text:
+            out += segment.text;
+            break;
+        case PromptPart::Cwd:
+            if (g_prompt.cwd_generation != g_cwd_generation) {
+                g_prompt.cwd = prompt$cwd();
+                g_prompt.cwd_generation = g_cwd_generation;
+            }
+
+            out += g_prompt.cwd;
+            break;
+        case PromptPart::Time:
+            prompt$time(out);
+            break;
+        case PromptPart::Status:
+            out += std::to_string(g_exit_fg);
+            break;
+        case PromptPart::Jobs:
+            out += std::to_string(jobs$count());
+            break;
+        }
+    }
+
+    return out;
+}
 }
@@ -1,10 +1,25 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 namespace BShell {
-std::string parse$PS_FMTSTR(char const&);
-std::string parse$PS(std::string const&);
+enum class PromptPart : char {
+    Text,   // literal text, including \u, \h and \$ which cannot change while we run
+    Cwd,    // \w
+    Time,   // \t
+    Status, // \?
+    Jobs    // \j
+};
+
+struct PromptSegment {
+    PromptPart part;
+    std::string text;
+};
+
+std::vector<PromptSegment> parse$PS(std::string const&);
 
-std::string const get$PS1();
+std::string const& get$PS1();
 
 void set$PS1(std::string);
 
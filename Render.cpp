@@ -0,0 +1,187 @@
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "Render.h"
+
+namespace BShell {
+RenderStats g_render_stats = {};
+
+// SGR sequence for each Color.
+constexpr char const* g_sgr[] = { "\x1b[0m", "\x1b[31m", "\x1b[32m", "\x1b[34m", "\x1b[36m" };
+
+// What is currently on screen: the prompt followed by the input, one color per byte.
+struct Frame {
+    std::string text;
+    std::string colors;
+};
+
+Frame g_frame;
+size_t g_prompt_size = 0;
+size_t g_columns = 80;
+size_t g_position = 0; // cell the terminal cursor is on, relative to the start of the frame
+std::string g_out;
+
+size_t render$cells(std::string_view text) {
+    // UTF-8 continuation bytes do not start a new cell.
+    auto cells = size_t {};
+
+    for (auto c : text)
+        cells += (c & 0xC0) != 0x80;
+
+    return cells;
+}
+
+void render$move(size_t to) {
+    // Relative movement only, so the frame can start anywhere on the screen.
+    auto from_row = g_position / g_columns, from_col = g_position % g_columns;
+    auto to_row = to / g_columns, to_col = to % g_columns;
+
+    if (to_row < from_row)
+        g_out += "\x1b[" + std::to_string(from_row - to_row) + "A";
+    else if (to_row > from_row)
+        g_out += "\x1b[" + std::to_string(to_row - from_row) + "B";
+
+    if (to_col != from_col) {
+        g_out += '\r';
+
+        if (to_col)
+            g_out += "\x1b[" + std::to_string(to_col) + "C";
+    }
+
+    g_position = to;
+}
+
+void render$flush() {
+    // The whole update goes out in a single write.
+    auto* buf = g_out.data();
+    auto size = g_out.size();
+
+    g_render_stats.frames++;
+
+    while (size) {
+        auto count = write(STDOUT_FILENO, buf, size);
+
+        g_render_stats.writes++;
+
+        if (count < 0) {
+            perror("write()");
+            break;
+        }
+
+        buf += count;
+        size -= count;
+    }
+
+    g_render_stats.bytes += g_out.size();
+    g_out.clear();
+}
+
+void render$frame(Frame&& frame, size_t cursor) {
+    auto& old = g_frame;
+    auto i = size_t {};
+    auto size = std::min(frame.text.size(), old.text.size());
+
+    while (i < size && frame.text[i] == old.text[i] && frame.colors[i] == old.colors[i])
+        i++;
+
+    // Never start redrawing in the middle of a UTF-8 sequence.
+    while (i && i < frame.text.size() && (frame.text[i] & 0xC0) == 0x80)
+        i--;
+
+    if (i < frame.text.size() || i < old.text.size()) {
+        auto old_cells = render$cells(old.text);
+        auto color = char { Default }; // the terminal is left at Default after every frame
+
+        render$move(render$cells(std::string_view { frame.text }.substr(0, i)));
+
+        for (; i < frame.text.size(); i++) {
+            if (frame.colors[i] != color) {
+                color = frame.colors[i];
+                g_out += g_sgr[static_cast<size_t>(color)];
+            }
+
+            g_out += frame.text[i];
+        }
+
+        if (color > Default)
+            g_out += g_sgr[Default];
+
+        auto cells = render$cells(frame.text);
+
+        // Writing up to the last column leaves the cursor pending a wrap, so wrap
+        // explicitly to keep our idea of its position right.
+        if (cells > g_position && cells % g_columns == 0)
+            g_out += "\r\n";
+
+        g_position = cells;
+
+        if (old_cells > cells)
+            g_out += "\x1b[J";
+    }
+
+    g_frame = std::move(frame);
+
+    render$move(render$cells(std::string_view { g_frame.text }.substr(0, cursor)));
+    render$flush();
+}
+
+void render$begin(std::string_view prompt) {
+    auto size = winsize {};
+
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col)
+        g_columns = size.ws_col;
+
+    g_frame = Frame {};
+    g_position = 0;
+    g_prompt_size = prompt.size();
+    g_out = "\x1b[2K\r";
+
+    render$frame(Frame { std::string { prompt }, std::string(prompt.size(), Default) },
+                 prompt.size());
+}
+
+void render$line(std::string_view input, std::string_view colors, size_t cursor) {
+    auto frame = Frame { g_frame.text.substr(0, g_prompt_size),
+                         g_frame.colors.substr(0, g_prompt_size) };
+
+    frame.text += input;
+    frame.colors += colors;
+
+    render$frame(std::move(frame), g_prompt_size + cursor);
+}
+
+void render$prompt(std::string_view prompt) {
+    // Swap the prompt in front of the input, the cursor is placed by the next render$line.
+    auto frame = Frame { std::string { prompt }, std::string(prompt.size(), Default) };
+
+    frame.text += g_frame.text.substr(g_prompt_size);
+    frame.colors += g_frame.colors.substr(g_prompt_size);
+    g_prompt_size = prompt.size();
+
+    render$frame(std::move(frame), g_prompt_size);
+}
+
+void render$cursor(size_t cursor) {
+    render$move(render$cells(std::string_view { g_frame.text }.substr(0, g_prompt_size + cursor)));
+    render$flush();
+}
+
+void render$end() {
+    // Park the cursor after the last line of the frame before anything else is printed.
+    render$move(render$cells(g_frame.text));
+    render$flush();
+}
+
+void render$print_stats() {
+    auto frames = std::max(g_render_stats.frames, size_t { 1 });
+
+    std::cerr << "render: " << g_render_stats.frames << " frames, "
+              << double(g_render_stats.bytes) / frames << " bytes/frame, "
+              << double(g_render_stats.writes) / frames << " writes/frame\n";
+}
+}
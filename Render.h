@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace BShell {
+enum Color : char { Default, Red, Green, Blue, Cyan };
+
+struct RenderStats {
+    size_t frames; // frames rendered, i.e. keystrokes that touched the screen
+    size_t bytes;  // bytes written to the terminal
+    size_t writes; // write(2) calls
+};
+
+void render$begin(std::string_view);
+void render$line(std::string_view, std::string_view, size_t);
+void render$prompt(std::string_view);
+void render$cursor(size_t);
+void render$end();
+void render$print_stats();
+
+extern RenderStats g_render_stats;
+}
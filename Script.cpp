@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "CommandTable.h"
+#include "Interpreter.h"
+#include "Jobs.h"
+#include "Parser.h"
+#include "Script.h"
+#include "ScriptCache.h"
+#include "Tokenizer.h"
+#include "Trace.h"
+
+namespace BShell {
+constexpr auto g_script_buffer = size_t { 1 } << 20;
+// What is read at once from a seekable stdin, all but one statement is given back.
+constexpr auto g_script_shared_read = size_t { 1 } << 12;
+
+ScriptReader::ScriptReader(int fd)
+    : m_fd(fd)
+    , m_shared(fd == STDIN_FILENO)
+    , m_seekable(m_shared && lseek(fd, 0, SEEK_CUR) >= 0)
+    , m_buffer(std::make_unique<char[]>(g_script_buffer)) {
+}
+
+ScriptReader::ScriptReader(std::string_view source)
+    : m_fd(-1)
+    , m_buffer(std::make_unique<char[]>(source.size()))
+    , m_end(source.size()) {
+    // Statements are cleaned up in place, so even -c gets its own copy.
+    memcpy(m_buffer.get(), source.data(), source.size());
+}
+
+bool ScriptReader::fill() {
+    if (m_fd < 0)
+        return false;
+
+    auto bytes = ssize_t {};
+    auto size = !m_shared ? g_script_buffer : m_seekable ? g_script_shared_read : 1;
+
+    m_begin = m_end = 0;
+
+    // A pipe cannot be given back what was read from it, so it is read a byte at a
+    // time up to the end of the line like POSIX asks.
+    do {
+        while ((bytes = read(m_fd, m_buffer.get() + m_end, size)) < 0 && errno == EINTR)
+            ;
+
+        m_end += bytes > 0 ? bytes : 0;
+    } while (bytes > 0 && size == 1 && m_buffer[m_end - 1] != '\n' && m_end < g_script_buffer);
+
+    if (bytes < 0)
+        perror("read()");
+
+    return m_end;
+}
+
+void ScriptReader::unread() {
+    // Moves the offset of a seekable stdin back to the end of the statement about to
+    // run, the commands in it read what follows.
+    if (!m_seekable || m_begin == m_end)
+        return;
+
+    lseek(m_fd, static_cast<off_t>(m_begin) - static_cast<off_t>(m_end), SEEK_CUR);
+    m_end = m_begin;
+}
+
+void ScriptReader::track(char c) {
+    // Only a reserved word in command position opens or closes a compound command,
+    // `echo done` does neither.
+    if (!strchr(" \t\r\n;&|()<>", c)) {
+        m_word += c;
+        return;
+    }
+
+    if (m_word.size()) {
+        m_depth = std::max(0, m_depth + (m_command ? keyword$nesting(m_word) : 0));
+        m_command = m_command && keyword$leads(m_word);
+        m_word.clear();
+    }
+
+    if (strchr(";&|()\n", c))
+        m_command = true;
+}
+
+bool ScriptReader::scan(char& c, char prev) {
+    // Rewrites c into what the tokenizer expects and returns whether it ends the
+    // statement. Newlines only do so outside of quotes, $() and compound commands,
+    // and comments are blanked up to the end of their line.
+    auto const top = m_quotes.empty() ? '\0' : m_quotes.back();
+
+    if (m_comment) {
+        if (c != '\n') {
+            c = ' ';
+            return false;
+        }
+
+        m_comment = false;
+    }
+
+    if (!top && !(c == '#' && strchr(" \t\n;&|", prev)))
+        track(c);
+
+    if (top == '\'') {
+        if (c == '\'')
+            m_quotes.pop_back();
+
+        return false;
+    }
+
+    switch (c) {
+    case '"':
+        if (top == '"')
+            m_quotes.pop_back();
+        else
+            m_quotes.push_back(c);
+
+        return false;
+    case '`':
+        if (top == '`')
+            m_quotes.pop_back();
+        else if (top != '"')
+            m_quotes.push_back(c);
+
+        return false;
+    case '\'':
+        if (top != '"')
+            m_quotes.push_back(c);
+
+        return false;
+    case '(':
+        if (prev == '$')
+            m_quotes.push_back(c);
+
+        return false;
+    case ')':
+        if (top == '(')
+            m_quotes.pop_back();
+
+        return false;
+    }
+
+    // Everything below only applies to unquoted text.
+    if (top == '"' || top == '`')
+        return false;
+
+    switch (c) {
+    case '#':
+        if (!strchr(" \t\n;&|", prev))
+            return false;
+
+        m_comment = true;
+        c = ' ';
+        return false;
+    case '\t':
+    case '\r':
+        c = ' ';
+        return false;
+    case '\n':
+        if (!top)
+            return !m_depth;
+
+        c = ' ';
+        return false;
+    }
+
+    return false;
+}
+
+std::optional<std::string_view> ScriptReader::next() {
+    TRACE_SCOPE("read");
+
+    while (true) {
+        if (m_begin == m_end && !fill()) {
+            // The last statement does not need a newline.
+            if (!m_carry)
+                return std::nullopt;
+
+            m_carry = false;
+            return m_statement;
+        }
+
+        auto* data = m_buffer.get();
+        auto start = m_begin;
+
+        for (auto i = m_begin; i < m_end; i++) {
+            auto const prev = m_last;
+            m_last = data[i];
+
+            // A backslash before a newline joins the two lines.
+            if (data[i] == '\n' && prev == '\\' && !m_comment
+                && (m_quotes.empty() || m_quotes.back() != '\'')) {
+                (i > start ? data[i - 1] : m_statement.back()) = ' ';
+                data[i] = ' ';
+                continue;
+            }
+
+            if (!scan(data[i], prev))
+                continue;
+
+            m_begin = i + 1;
+            unread();
+
+            auto statement = std::string_view { data + start, i - start };
+
+            if (!m_carry)
+                return statement;
+
+            m_carry = false;
+            m_statement.append(statement);
+            return m_statement;
+        }
+
+        // The statement goes on in the next read.
+        if (!m_carry)
+            m_statement.clear();
+
+        m_statement.append(data + start, m_end - start);
+        m_carry = true;
+        m_begin = m_end;
+    }
+}
+
+int script$run(ScriptReader& reader, CacheWriter* cache) {
+    while (auto statement = reader.next()) {
+        // A script may install the command it runs next, so the table is rechecked
+        // before each statement like it is before each prompt.
+        hash$revalidate();
+        jobs$notify(false);
+
+        if (statement->find_first_not_of(' ') == std::string_view::npos)
+            continue;
+
+        auto tokenizer = Tokenizer(*statement);
+        auto ast = Parser(tokenizer).ast();
+
+        // A statement that did not parse prints its error on every run, so it cannot
+        // be cached. Neither can a script that uses aliases, whether one is expanded
+        // may depend on what ran before.
+        if (cache && (ast.roots().empty() || tokenizer.uses_aliases()))
+            cache->abandon();
+        else if (cache)
+            cache->add(ast);
+
+        for (auto root : ast.roots()) {
+            handle$ast(ast.at(root));
+
+            if (g_shell_exit)
+                break;
+        }
+
+        if (g_shell_exit) {
+            // The cache would end where this run did, whether or not the next run exits.
+            if (cache && reader.next())
+                cache->abandon();
+
+            break;
+        }
+    }
+
+    return g_exit_fg;
+}
+
+int script$run_file(int fd, char const* path, bool report) {
+    // Scripts run from a file skip the tokenizer and parser when an earlier run left
+    // a cache that still matches them.
+    auto key = cache$key(fd, path);
+
+    if (key && cache$run(*key)) {
+        if (report)
+            std::cerr << path << ": cache hit\n";
+
+        return g_exit_fg;
+    }
+
+    auto reader = ScriptReader { fd };
+
+    if (!key) {
+        if (report)
+            std::cerr << path << ": cache miss\n";
+
+        return script$run(reader);
+    }
+
+    auto cache = CacheWriter { *key };
+    auto status = script$run(reader, &cache);
+    auto stored = cache.commit();
+
+    if (report)
+        std::cerr << path << ": cache miss" << (stored ? ", stored" : "") << '\n';
+
+    return status;
+}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace BShell {
+// Splits a script into statements while reading it, so only one buffer and the
+// statement being run are ever in memory.
+class ScriptReader {
+public:
+    explicit ScriptReader(int fd);
+    explicit ScriptReader(std::string_view source);
+
+    std::optional<std::string_view> next();
+
+private:
+    bool fill();
+    void unread();
+    bool scan(char&, char);
+    void track(char);
+
+    int m_fd;
+    // The shell's own stdin, which the commands of the script read from too. Nothing
+    // past the statement being run may be taken from it.
+    bool m_shared = false;
+    bool m_seekable = false;
+    std::unique_ptr<char[]> m_buffer;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+
+    // A statement that straddles two reads is moved here.
+    std::string m_statement;
+    bool m_carry = false;
+
+    // Quotes and $( that are still open, innermost last.
+    std::string m_quotes;
+    char m_last = '\n';
+    bool m_comment = false;
+
+    // Compound commands go on over newlines until the reserved word that closes them.
+    std::string m_word; // the unquoted word being read
+    bool m_command = true; // whether it is in command position
+    int m_depth = 0;
+};
+
+class CacheWriter;
+
+int script$run(ScriptReader&, CacheWriter* = nullptr);
+int script$run_file(int, char const*, bool);
+}
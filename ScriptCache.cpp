@@ -0,0 +1,324 @@
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "CommandTable.h"
+#include "Interpreter.h"
+#include "Jobs.h"
+#include "Parser.h"
+#include "ScriptCache.h"
+#include "System.h"
+#include "Trace.h"
+#include "Variables.h"
+
+namespace BShell {
+// A cache file is the header, the script path and one record per statement, each
+// record being its nodes, roots and text. Everything is padded to 4 bytes so the
+// nodes can be used straight from the mapping.
+constexpr char g_cache_magic[8] = { 'B', 'S', 'H', 'A', 'S', 'T', '0', '1' };
+
+struct CacheHeader {
+    char magic[8];
+    uint64_t binary, commands, size, mtime, hash;
+    uint64_t statements;
+    uint32_t path;
+    uint32_t node_size;
+};
+
+struct CacheRecord {
+    uint32_t nodes, roots, text;
+};
+
+constexpr size_t cache$pad(size_t size) { return (size + 3) & ~size_t { 3 }; }
+
+std::string cache$dir() {
+    auto* xdg = var$get("XDG_CACHE_HOME");
+    auto dir = xdg && *xdg ? std::string { xdg } : get$home() + "/.cache";
+
+    mkdir(dir.c_str(), 0755);
+    dir += "/bshell";
+    mkdir(dir.c_str(), 0755);
+
+    return dir;
+}
+
+uint64_t cache$binary() {
+    // Rebuilding or replacing the shell changes the layout the nodes were written in.
+    struct stat st { };
+
+    if (stat("/proc/self/exe", &st) < 0)
+        return 0;
+
+    auto id = std::hash<uint64_t> {}(st.st_ino) ^ st.st_dev;
+
+    id = id * 31 + st.st_size;
+    id = id * 31 + st.st_mtim.tv_sec;
+    return id * 31 + st.st_mtim.tv_nsec;
+}
+
+std::optional<CacheKey> cache$key(int fd, char const* path) {
+    struct stat st { };
+    char script[PATH_MAX];
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !realpath(path, script))
+        return std::nullopt;
+
+    auto key = CacheKey {};
+
+    key.script = script;
+    key.binary = cache$binary();
+    key.commands = hash$stamp();
+    key.size = st.st_size;
+    key.mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+
+    // The content is hashed as well, an edit within the same mtime tick must not hit.
+    if (st.st_size) {
+        auto* map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map == MAP_FAILED)
+            return std::nullopt;
+
+        key.hash = std::hash<std::string_view> {}({ static_cast<char const*>(map), key.size });
+        munmap(map, st.st_size);
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "/%016zx.ast", std::hash<std::string> {}(key.script));
+
+    key.file = cache$dir() + name;
+
+    return key;
+}
+
+CacheWriter::CacheWriter(CacheKey const& key)
+    : m_key(key)
+    , m_temp(key.file + ".tmp." + std::to_string(getpid()))
+    , m_fd(open(m_temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) {
+    // The magic is only filled in by commit(), a partial file never looks valid.
+    auto header = CacheHeader {};
+
+    write(&header, sizeof(header));
+    write(m_key.script.data(), m_key.script.size());
+    pad(m_key.script.size());
+}
+
+CacheWriter::~CacheWriter() { abandon(); }
+
+void CacheWriter::write(void const* data, size_t size) {
+    m_buffer.append(static_cast<char const*>(data), size);
+
+    if (m_buffer.size() >= 1 << 16)
+        flush();
+}
+
+void CacheWriter::pad(size_t size) {
+    constexpr char zeros[4] = {};
+
+    write(zeros, cache$pad(size) - size);
+}
+
+bool CacheWriter::flush() {
+    if (m_fd < 0)
+        return false;
+
+    for (size_t done = 0; done < m_buffer.size();) {
+        auto bytes = ::write(m_fd, m_buffer.data() + done, m_buffer.size() - done);
+
+        if (bytes < 0 && errno == EINTR)
+            continue;
+
+        if (bytes < 0) {
+            abandon();
+            return false;
+        }
+
+        done += bytes;
+    }
+
+    m_buffer.clear();
+    return true;
+}
+
+void CacheWriter::add(Ast const& ast) {
+    if (m_fd < 0)
+        return;
+
+    auto nodes = ast.nodes();
+    auto roots = ast.roots();
+    auto text = ast.text();
+    auto record = CacheRecord { static_cast<uint32_t>(nodes.size()),
+                                static_cast<uint32_t>(roots.size()),
+                                static_cast<uint32_t>(text.size()) };
+
+    write(&record, sizeof(record));
+    write(nodes.data(), nodes.size_bytes());
+    write(roots.data(), roots.size_bytes());
+    write(text.data(), text.size());
+    pad(text.size());
+
+    m_statements++;
+}
+
+void CacheWriter::abandon() {
+    if (m_fd < 0)
+        return;
+
+    close(m_fd);
+    unlink(m_temp.c_str());
+
+    m_fd = -1;
+}
+
+bool CacheWriter::commit() {
+    if (!flush())
+        return false;
+
+    auto header = CacheHeader {};
+
+    memcpy(header.magic, g_cache_magic, sizeof(header.magic));
+    header.binary = m_key.binary;
+    header.commands = m_key.commands;
+    header.size = m_key.size;
+    header.mtime = m_key.mtime;
+    header.hash = m_key.hash;
+    header.statements = m_statements;
+    header.path = m_key.script.size();
+    header.node_size = sizeof(ExpressionNode);
+
+    if (pwrite(m_fd, &header, sizeof(header), 0) != sizeof(header)
+        || rename(m_temp.c_str(), m_key.file.c_str()) < 0) {
+        abandon();
+        return false;
+    }
+
+    close(m_fd);
+    m_fd = -1;
+
+    return true;
+}
+
+template <typename F>
+bool cache$walk(std::string_view data, uint64_t statements, F&& fn) {
+    // Visits every record, returning false as soon as one does not fit the file or
+    // refers outside of itself.
+    for (auto i = uint64_t {}; i < statements; i++) {
+        auto record = CacheRecord {};
+
+        if (data.size() < sizeof(record))
+            return false;
+
+        memcpy(&record, data.data(), sizeof(record));
+        data.remove_prefix(sizeof(record));
+
+        auto node_bytes = size_t { record.nodes } * sizeof(ExpressionNode);
+        auto root_bytes = size_t { record.roots } * sizeof(uint32_t);
+        auto size = cache$pad(node_bytes + root_bytes + record.text);
+
+        if (data.size() < size)
+            return false;
+
+        auto nodes = std::span { reinterpret_cast<ExpressionNode const*>(data.data()),
+                                 record.nodes };
+        auto roots = std::span { reinterpret_cast<uint32_t const*>(data.data() + node_bytes),
+                                 record.roots };
+        auto text = data.substr(node_bytes + root_bytes, record.text);
+
+        if (!fn(text, nodes, roots))
+            return false;
+
+        data.remove_prefix(size);
+    }
+
+    return true;
+}
+
+bool cache$valid(std::string_view text, std::span<ExpressionNode const> nodes,
+                 std::span<uint32_t const> roots) {
+    auto index = [&](uint32_t i) { return i == NoExpression || i < nodes.size(); };
+
+    for (auto const& node : nodes)
+        if (size_t { node.offset } + node.length > text.size() || !index(node.first)
+            || !index(node.last) || !index(node.next))
+            return false;
+
+    for (auto root : roots)
+        if (root >= nodes.size())
+            return false;
+
+    return true;
+}
+
+bool cache$run(CacheKey const& key) {
+    TRACE_SCOPE("cache");
+
+    // Runs the cached parse of a script, returns false without running anything when
+    // there is no usable one.
+    auto fd = open(key.file.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st { };
+
+    if (fd < 0)
+        return false;
+
+    auto* map = fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(CacheHeader)
+        ? MAP_FAILED
+        : mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return false;
+
+    auto data = std::string_view { static_cast<char const*>(map), size_t(st.st_size) };
+    auto header = CacheHeader {};
+
+    memcpy(&header, data.data(), sizeof(header));
+    data.remove_prefix(sizeof(header));
+
+    auto hit = !memcmp(header.magic, g_cache_magic, sizeof(header.magic))
+        && header.binary == key.binary && header.commands == key.commands
+        && header.size == key.size && header.mtime == key.mtime && header.hash == key.hash
+        && header.node_size == sizeof(ExpressionNode) && header.path == key.script.size()
+        && data.size() >= cache$pad(header.path) && data.starts_with(key.script);
+
+    if (hit) {
+        data.remove_prefix(cache$pad(header.path));
+
+        // Nothing may run before the whole file is known to be intact.
+        hit = cache$walk(data, header.statements, cache$valid);
+    }
+
+    if (hit) {
+        cache$walk(data, header.statements, [](auto text, auto nodes, auto roots) {
+            hash$revalidate();
+            jobs$notify(false);
+
+            auto ast = Ast { text, nodes, roots };
+
+            for (auto root : ast.roots()) {
+                handle$ast(ast.at(root));
+
+                if (g_shell_exit)
+                    return false;
+            }
+
+            return true;
+        });
+    }
+
+    munmap(map, st.st_size);
+
+    return hit;
+}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "Parser.h"
+
+namespace BShell {
+// One version of a script as parsed by one build of the shell, a cached parse is only
+// used when every field still matches.
+struct CacheKey {
+    std::string file;   // the cache file
+    std::string script; // canonical path of the script
+    uint64_t binary;    // the shell executable
+    uint64_t commands;  // hash$stamp(), the tokenizer classifies words against it
+    uint64_t size, mtime, hash;
+};
+
+// Streams the statements of a script into a new cache file, which only replaces the
+// old one once the whole script was parsed without errors.
+class CacheWriter {
+public:
+    explicit CacheWriter(CacheKey const&);
+    CacheWriter(CacheWriter const&) = delete;
+    ~CacheWriter();
+
+    void add(Ast const&);
+    void abandon();
+    bool commit();
+
+private:
+    void write(void const*, size_t);
+    void pad(size_t);
+    bool flush();
+
+    CacheKey const& m_key;
+    std::string m_temp;
+    std::string m_buffer;
+    int m_fd;
+    uint64_t m_statements = 0;
+};
+
+std::optional<CacheKey> cache$key(int, char const*);
+bool cache$run(CacheKey const&);
+}
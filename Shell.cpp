@@ -1,7 +1,11 @@
 #include <cstdlib>
 #include <iostream>
+#include <optional>
+#include <span>
+#include <string_view>
 // #include <format>
 
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -9,22 +13,82 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "CommandTable.h"
+#include "History.h"
 #include "Interpreter.h"
+#include "Jobs.h"
 #include "Parser.h"
 #include "PromptString.h"
+#include "Script.h"
 #include "Terminal.h"
+#include "Trace.h"
 
-void print$bgproc() {
-    for (auto const& proc : BShell::g_processes) {
-        if (waitpid(proc.pid, &BShell::g_exit_bg, WNOHANG) == 0)
-            continue;
+std::optional<int> script$main(int argc, char* argv[]) {
+    // shell [--report-cache] file [argument...], shell -c 'commands' [name [argument...]],
+    // or commands piped into stdin. Scripts never touch the terminal settings and exit
+    // with the status of their last command.
+    auto args = std::span { argv + 1, argv + argc };
+    auto report = args.size() && args[0] == std::string_view { "--report-cache" };
 
-        std::cout << '[' << (&proc - &*BShell::g_processes.begin() + 1) << "] Done " << proc.name
-                  << '\n';
+    // The words after the script, or after the name that stands in for one with -c,
+    // are $1, $2, ...
+    auto positional = [](std::span<char*> words) {
+        BShell::g_positional.assign(words.begin(), words.end());
+    };
+
+    BShell::g_script_name = argv[0];
+
+    if (report)
+        args = args.subspan(1);
+
+    if (args.size() && args[0] == std::string_view { "-c" }) {
+        if (args.size() < 2) {
+            std::cerr << argv[0] << ": -c: option requires an argument\n";
+            return 2;
+        }
+
+        if (args.size() > 2) {
+            BShell::g_script_name = args[2];
+            positional(args.subspan(3));
+        }
+
+        auto reader = BShell::ScriptReader { std::string_view { args[1] } };
+
+        BShell::jobs$init(false);
+        return BShell::script$run(reader);
+    }
+
+    if (args.size()) {
+        auto fd = open(args[0], O_RDONLY | O_CLOEXEC);
+
+        if (fd < 0) {
+            perror(args[0]);
+            return 127;
+        }
+
+        BShell::g_script_name = args[0];
+        positional(args.subspan(1));
+
+        BShell::jobs$init(false);
+        return BShell::script$run_file(fd, args[0], report);
+    }
+
+    if (!isatty(STDIN_FILENO)) {
+        auto reader = BShell::ScriptReader { STDIN_FILENO };
+
+        BShell::jobs$init(false);
+        return BShell::script$run(reader);
     }
+
+    return std::nullopt;
 }
 
-int main(int argc, int* argv[]) {
+int main(int argc, char* argv[]) {
+    BShell::trace$init();
+
+    if (auto status = script$main(argc, argv))
+        return *status;
+
     if (signal(SIGINT, BShell::handle$sigint) == SIG_ERR) {
         perror("signal()");
         exit(1);
@@ -32,25 +96,33 @@ int main(int argc, int* argv[]) {
 
     std::atexit(BShell::terminal$restore);
 
+    BShell::jobs$init(true);
+    BShell::history$open();
+
     // Continually prompt the user for input
     while (true) {
+        BShell::hash$revalidate();
+        BShell::jobs$notify();
+
         auto input = BShell::get$input(BShell::get$PS1());
 
         // CTRL+D causes terminal to send EOF, which is interpreted as \x1b[EOF
         if (input == "\x1b[EOF")
             break;
 
-        print$bgproc();
-        BShell::erase_dead_children();
-
         if (input.size()) {
-            BShell::g_history.push_back(input);
+            BShell::history$add(input);
+
+            auto tokenizer = BShell::Tokenizer(input);
+            auto ast = BShell::Parser(tokenizer).ast();
 
-            auto tokens = BShell::Tokenizer(input).tokens();
-            auto asts = BShell::Parser(std::move(tokens)).asts();
+            // Every node of the line is released at once when ast goes out of scope.
+            for (auto root : ast.roots()) {
+                BShell::handle$ast(ast.at(root));
 
-            for (auto&& ast : asts)
-                BShell::handle$ast(std::move(ast));
+                if (BShell::g_shell_exit)
+                    return BShell::g_exit_fg;
+            }
         }
     }
 
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Spawn.h"
+#include "Trace.h"
+#include "Variables.h"
+
+namespace BShell {
+void spawn$signals(sigset_t* set) {
+    // Signals the shell catches or ignores, and that children should get back.
+    sigemptyset(set);
+    sigaddset(set, SIGINT);
+    sigaddset(set, SIGTSTP);
+    sigaddset(set, SIGTTIN);
+    sigaddset(set, SIGTTOU);
+}
+
+pid_t spawn$process(std::string const& path, std::vector<std::string> const& args,
+                    FileActions const& actions, pid_t pgroup) {
+    TRACE_SCOPE("spawn");
+
+    // glibc implements posix_spawn with clone(CLONE_VM | CLONE_VFORK), so launching a
+    // command costs neither page table copies nor copy-on-write faults. The path has
+    // already been resolved through the command table, there is no PATH search here.
+    auto argv = std::vector<char*> {};
+    auto file_actions = posix_spawn_file_actions_t {};
+    auto attr = posix_spawnattr_t {};
+    auto mask = sigset_t {};
+    auto defaults = sigset_t {};
+    auto pid = pid_t {};
+
+    std::transform(args.begin(), args.end(), std::back_inserter(argv),
+                   [](std::string const& str) { return const_cast<char*>(str.c_str()); });
+
+    argv.push_back(NULL);
+
+    posix_spawn_file_actions_init(&file_actions);
+
+    for (auto const& action : actions) {
+        switch (action.kind) {
+        case FileAction::Open:
+            posix_spawn_file_actions_addopen(&file_actions, action.fd, action.path.c_str(),
+                                             action.flags, 0644);
+            break;
+        case FileAction::Dup:
+            posix_spawn_file_actions_adddup2(&file_actions, action.src, action.fd);
+            break;
+        case FileAction::Close:
+            posix_spawn_file_actions_addclose(&file_actions, action.fd);
+            break;
+        case FileAction::Foreground:
+            // Runs after setpgid with every signal blocked, so SIGTTOU cannot stop the child.
+            posix_spawn_file_actions_addtcsetpgrp_np(&file_actions, action.fd);
+            break;
+        }
+    }
+
+    // The child starts with an empty signal mask and default dispositions for
+    // anything the shell itself handles.
+    sigemptyset(&mask);
+    spawn$signals(&defaults);
+
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    if (pgroup >= 0)
+        posix_spawnattr_setpgroup(&attr, pgroup);
+
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+                                        | (pgroup >= 0 ? POSIX_SPAWN_SETPGROUP : 0));
+
+    std::cout.flush();
+
+    auto err = posix_spawn(&pid, path.c_str(), &file_actions, &attr, argv.data(), var$environ());
+
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&file_actions);
+
+    if (err) {
+        std::cerr << args[0] << ": " << strerror(err) << '\n';
+        return -1;
+    }
+
+    return pid;
+}
+
+bool spawn$action(FileAction const& action) {
+    // Same semantics as the posix_spawn file actions, for code that runs outside of it.
+    switch (action.kind) {
+    case FileAction::Open: {
+        auto file = open(action.path.c_str(), action.flags, 0644);
+
+        if (file < 0) {
+            perror("open()");
+            return false;
+        }
+
+        if (file != action.fd) {
+            dup2(file, action.fd);
+            close(file);
+        }
+    } break;
+    case FileAction::Dup:
+        if (dup2(action.src, action.fd) < 0) {
+            perror("dup2()");
+            return false;
+        }
+        break;
+    case FileAction::Close:
+        close(action.fd);
+        break;
+    case FileAction::Foreground:
+        tcsetpgrp(action.fd, getpgrp());
+        break;
+    }
+
+    return true;
+}
+
+bool spawn$apply(FileActions const& actions) {
+    return std::all_of(actions.begin(), actions.end(), spawn$action);
+}
+
+bool spawn$redirect(FileActions const& actions, SavedFds& saved) {
+    // For builtins running in the shell: every descriptor is copied away before the
+    // actions touch it, so spawn$restore can put the shell's own table back.
+    for (auto const& action : actions) {
+        if (action.kind == FileAction::Foreground)
+            continue;
+
+        auto fd = action.fd;
+
+        auto known = std::any_of(saved.begin(), saved.end(),
+                                 [&](auto const& pair) { return pair.first == fd; });
+
+        if (!known)
+            saved.emplace_back(fd, fcntl(fd, F_DUPFD_CLOEXEC, 10));
+
+        if (!spawn$action(action))
+            return false;
+    }
+
+    return true;
+}
+
+void spawn$restore(SavedFds& saved) {
+    for (auto it = saved.rbegin(); it != saved.rend(); it++) {
+        auto [fd, copy] = *it;
+
+        if (copy < 0) {
+            close(fd);
+            continue;
+        }
+
+        dup2(copy, fd);
+        close(copy);
+    }
+
+    saved.clear();
+}
+
+pid_t spawn$fork(FileActions const& actions, std::function<int()> body, pid_t pgroup) {
+    // Fallback for children that have to run arbitrary code before (or instead of) exec.
+    TRACE_SCOPE("fork");
+
+    std::cout.flush();
+
+    auto pid = fork();
+
+    if (pid < 0) {
+        perror("fork()");
+        exit(1);
+    } else if (!pid) {
+        auto signals = sigset_t {};
+        auto mask = sigset_t {};
+
+        if (pgroup >= 0)
+            setpgid(0, pgroup);
+
+        // Still ignoring SIGTTOU here, so taking the terminal cannot stop us.
+        if (!spawn$apply(actions))
+            _exit(1);
+
+        spawn$signals(&signals);
+
+        for (auto sig = 1; sig < NSIG; sig++)
+            if (sigismember(&signals, sig) == 1)
+                signal(sig, SIG_DFL);
+
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, nullptr);
+
+        auto status = body();
+
+        std::cout.flush();
+        _exit(status);
+    }
+
+    // Also set from the parent so the group exists before anything else joins it.
+    if (pgroup >= 0)
+        setpgid(pid, pgroup ? pgroup : pid);
+
+    return pid;
+}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace BShell {
+// A change to the child's file descriptor table, applied in order before exec.
+struct FileAction {
+    enum Kind { Open, Dup, Close, Foreground };
+
+    Kind kind;
+    int fd;    // descriptor being opened, duplicated onto or closed (Foreground: the terminal)
+    int src;   // Dup: descriptor duplicated onto fd
+    int flags; // Open: open(2) flags
+    std::string path;
+};
+
+using FileActions = std::vector<FileAction>;
+
+// Descriptors replaced in the shell itself, and the copies to restore them from (-1 if
+// the descriptor was closed before).
+using SavedFds = std::vector<std::pair<int, int>>;
+
+// pgroup: -1 keeps the shell's process group, 0 starts a new one, otherwise joins it.
+pid_t spawn$process(std::string const&, std::vector<std::string> const&, FileActions const&,
+                    pid_t = -1);
+pid_t spawn$fork(FileActions const&, std::function<int()>, pid_t = -1);
+bool spawn$apply(FileActions const&);
+bool spawn$redirect(FileActions const&, SavedFds&);
+void spawn$restore(SavedFds&);
+}
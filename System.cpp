@@ -1,23 +1,61 @@
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 
+#include <dirent.h>
 #include <pwd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "Parser.h"
 #include "System.h"
 #include "Tokenizer.h"
+#include "Variables.h"
 
 namespace BShell {
-std::string get$cwd() {
-    // From getcwd(3) it says get_current_dir_name() will malloc a
-    // string large enough to fit the current working dir.
-    // While getcwd() requires us to create our own string buffer.
+size_t g_cwd_generation = 0;
+std::string g_prev_wd = "";
+
+// The logical working directory keeps the symlinks it was reached through, like $PWD.
+// The physical one is only resolved when asked for. Both change only in set$cwd.
+std::string g_cwd_logical, g_cwd_physical;
+
+std::string path$normalize(std::string_view path) {
+    // Lexically resolve ".", ".." and repeated slashes in an absolute path.
+    auto normal = std::string {};
+
+    while (path.size()) {
+        auto slash = path.find('/');
+        auto part = path.substr(0, slash);
+
+        path.remove_prefix(slash == std::string_view::npos ? path.size() : slash + 1);
+
+        if (part.empty() || part == ".")
+            continue;
+
+        if (part == "..")
+            normal.resize(normal.empty() ? 0 : normal.rfind('/'));
+        else
+            (normal += '/') += part;
+    }
+
+    return normal.size() ? normal : "/";
+}
+
+std::string cwd$physical() {
+    // get_current_dir_name() would hand back $PWD when it names the same directory,
+    // getcwd(3) with a null buffer mallocs a string with the resolved path.
+    auto* buf = getcwd(nullptr, 0);
+
+    if (!buf) {
+        perror("getcwd()");
+        return {};
+    }
 
-    auto* buf = get_current_dir_name();
     auto cwd = std::string(buf);
 
     free(buf);
@@ -25,11 +63,65 @@ std::string get$cwd() {
     return cwd;
 }
 
+bool cwd$same(char const* a, char const* b) {
+    struct stat sa, sb;
+
+    return stat(a, &sa) == 0 && stat(b, &sb) == 0 && sa.st_dev == sb.st_dev
+           && sa.st_ino == sb.st_ino;
+}
+
+std::string const& get$cwd() {
+    if (g_cwd_logical.empty()) {
+        // An inherited $PWD is kept if it still names the directory we are in.
+        auto* pwd = var$get("PWD");
+
+        if (pwd && pwd[0] == '/' && path$normalize(pwd) == pwd && cwd$same(pwd, "."))
+            g_cwd_logical = pwd;
+        else
+            g_cwd_logical = g_cwd_physical = cwd$physical();
+
+        var$set("PWD", g_cwd_logical, true);
+    }
+
+    return g_cwd_logical;
+}
+
+std::string const& get$cwd_physical() {
+    if (g_cwd_physical.empty())
+        g_cwd_physical = cwd$physical();
+
+    return g_cwd_physical;
+}
+
+bool set$cwd(std::string const& dir) {
+    auto old = get$cwd();
+    auto logical = path$normalize(dir[0] == '/' ? dir : old + '/' + dir);
+
+    // ".." is resolved against the logical path first, as in `cd -L`; if that
+    // path does not exist the directory is looked up as given.
+    if (chdir(logical.c_str()) == 0) {
+        g_cwd_logical = std::move(logical);
+        g_cwd_physical.clear();
+    } else if (chdir(dir.c_str()) == 0) {
+        g_cwd_logical = g_cwd_physical = cwd$physical();
+    } else {
+        return false;
+    }
+
+    g_prev_wd = std::move(old);
+    g_cwd_generation++;
+
+    var$set("OLDPWD", g_prev_wd, true);
+    var$set("PWD", g_cwd_logical, true);
+
+    return true;
+}
+
 std::string get$home() {
-    // Use getenv "HOME" otherwise, fallback to getpwuid(3)
+    // Use $HOME, otherwise fallback to getpwuid(3)
     // and getuid(3) to get the user's home directory.
 
-    auto* buf = getenv("HOME");
+    auto* buf = var$get("HOME");
 
     if (buf == nullptr)
         buf = getpwuid(getuid())->pw_dir;
@@ -39,10 +131,10 @@ std::string get$home() {
 
 std::string get$username() {
     // getlogin(3)
-    // Suggests that we use getenv to get "LOGNAME", otherwise
+    // Suggests that we use $LOGNAME, otherwise
     // fallback to getlogin(), then getlogin_r()
 
-    auto* buf = getenv("LOGNAME");
+    char const* buf = var$get("LOGNAME");
     auto uptr = std::unique_ptr<char[]> {};
 
     if (buf == nullptr && (buf = getlogin()) == nullptr) {
@@ -50,7 +142,7 @@ std::string get$username() {
         uptr = std::make_unique<char[]>(32);
         buf = uptr.get();
 
-        if (getlogin_r(buf, 32) != 0) {
+        if (getlogin_r(uptr.get(), 32) != 0) {
             perror("getlogin_r()");
             exit(1);
         }
@@ -60,7 +152,7 @@ std::string get$username() {
 }
 
 std::string get$hostname() {
-    auto* buf = getenv("HOSTNAME");
+    auto* buf = var$get("HOSTNAME");
     auto uptr = std::unique_ptr<char[]> {};
 
     if (buf == nullptr) {
@@ -68,7 +160,7 @@ std::string get$hostname() {
         uptr = std::make_unique<char[]>(253);
         buf = uptr.get();
 
-        if (gethostname(buf, 253) != 0) {
+        if (gethostname(uptr.get(), 253) != 0) {
             perror("gethostname()");
             exit(1);
         }
@@ -83,38 +175,59 @@ std::string get$pname(pid_t const& pid) {
     return std::string { std::istreambuf_iterator { proc.rdbuf() }, {} };
 }
 
-std::string get$pname(std::shared_ptr<Expression> const& expr) {
+std::string get$pname(Expression const& expr) {
     auto pname = std::string {};
 
-    if (expr->token.type != Executable)
-        return pname;
+    // Compound commands go by their reserved word, the Compound node of their
+    // redirections by the command it wraps.
+    if (expr.type() == Compound) {
+        auto word = expr.content();
 
-    pname = expr->token.content;
+        return std::string { word == ">" || word == "<" ? expr.front().content() : word };
+    }
 
-    if (expr->children.size())
-        for (auto const& c : expr->children)
-            pname += ' ' + c->token.content;
+    if (!(expr.type() & (Executable | Key | Function)))
+        return pname;
+
+    pname = expr.content();
+
+    for (auto const& c : expr.children()) {
+        pname += ' ';
+
+        if (c.type() == Eval) {
+            pname += "$(";
+            pname += c.content();
+            pname += ')';
+        } else if (c.type() & (RedirectIn | RedirectOut)) {
+            pname += c.content();
+            pname += ' ';
+            pname += c.front().content();
+        } else {
+            pname += c.content();
+        }
+    }
 
     return pname;
 }
 
-std::string get$executable_path(std::string const& cmd) {
-    // Scans the path for executables that match the given string
+void dir$scan(int fd, std::function<void(std::string_view, unsigned char)> const& fn) {
+    // getdents64 fills a large buffer per call, a directory of 100k entries takes a few
+    // dozen syscalls and nothing is allocated per entry.
+    constexpr auto size = size_t { 1 } << 18;
 
-    auto env_path = std::string(getenv("PATH"));
-    auto path = std::string {};
+    auto buffer = std::make_unique<char[]>(size);
+    auto count = ssize_t {};
 
-    auto i = size_t {}, j = env_path.find(':');
+    while ((count = getdents64(fd, buffer.get(), size)) > 0) {
+        for (auto at = ssize_t {}; at < count;) {
+            auto* entry = reinterpret_cast<dirent64 const*>(buffer.get() + at);
+            auto name = std::string_view { entry->d_name };
 
-    for (; j != std::string::npos; j = env_path.find(':', i = j + 1)) {
-        auto tmp = env_path.substr(i, j - i) + "/" + cmd;
+            at += entry->d_reclen;
 
-        if (access(tmp.c_str(), X_OK) != -1) {
-            path = tmp;
-            break;
+            if (name != "." && name != "..")
+                fn(name, entry->d_type);
         }
     }
-
-    return path;
 }
 }
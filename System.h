@@ -1,13 +1,23 @@
 #pragma once
 
+#include <functional>
+#include <string>
+#include <string_view>
+
 #include "Parser.h"
 
 namespace BShell {
-std::string get$cwd();
+std::string const& get$cwd();
+std::string const& get$cwd_physical();
+bool set$cwd(std::string const&);
 std::string get$home();
 std::string get$username();
 std::string get$hostname();
 std::string get$pname(pid_t const&);
-std::string get$pname(std::shared_ptr<Expression> const&);
-std::string get$executable_path(std::string const&);
+std::string get$pname(Expression const&);
+// Calls back with the name and d_type of every entry of an open directory but . and ..
+void dir$scan(int, std::function<void(std::string_view, unsigned char)> const&);
+
+extern size_t g_cwd_generation; // bumped whenever the working directory changes
+extern std::string g_prev_wd;
 }
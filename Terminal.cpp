@@ -1,7 +1,7 @@
-#include <filesystem>
+#include <algorithm>
 #include <iostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include <stdio.h>
@@ -9,22 +9,21 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "Complete.h"
+#include "Highlight.h"
+#include "History.h"
+#include "Input.h"
 #include "PromptString.h"
+#include "Render.h"
 #include "System.h"
 #include "Terminal.h"
 #include "Tokenizer.h"
+#include "Trace.h"
 
 namespace BShell {
 termios g_term, g_oterm;
-std::vector<std::string> g_history = std::vector<std::string> {};
-
-std::unordered_map<TokenType, std::string> g_token_colors = {
-    { NullToken, "\x1b[0m" },     { String, "\x1b[0m" },        { Equal, "\x1b[0m" },
-    { Executable, "\x1b[34m" },   { Background, "\x1b[31m" },   { Sequential, "\x1b[31m" },
-    { SequentialIf, "\x1b[32m" }, { RedirectPipe, "\x1b[32m" }, { RedirectOut, "\x1b[32m" },
-    { RedirectIn, "\x1b[32m" },   { Key, "\x1b[34m" },          { Eval, "\x1b[36m" },
-    { StickyRight, "\x1b[0m" },   { StickyLeft, "\x1b[0m" },    { WhiteSpace, "\x1b[0m" },
-};
+
+Highlighter g_highlighter;
 
 void handle$sigint(int) {
     // We do not want the shell to exit on SIGINT
@@ -42,40 +41,51 @@ void terminal$control() {
     tcsetattr(STDIN_FILENO, TCSANOW, &BShell::g_term);
 
     std::cout.setf(std::ios::unitbuf);
+
+    // Bracketed paste, pasted text arrives between \x1b[200~ and \x1b[201~.
+    std::cout << "\x1b[?2004h";
 }
 
 void terminal$restore() {
+    std::cout << "\x1b[?2004l";
+
     tcsetattr(STDIN_FILENO, TCSANOW, &BShell::g_oterm);
-    std::cout.setf(~std::ios::unitbuf);
+    std::cout.unsetf(std::ios::unitbuf);
 }
 
-std::string line$color(std::string input) {
-    auto str = std::string {};
-    auto tokens = Tokenizer(input, true).tokens();
-
-    for (auto const& t : tokens)
-        str += g_token_colors[t.type] + t.content;
+// Repaints wait until every buffered key has been handled, so typed-ahead input
+// costs one frame instead of one per key.
+std::string const* g_pending_line = nullptr;
+size_t g_pending_cursor = 0;
 
-    return str + "\x1b[0m";
+void line$reprint(std::string const& input, int x) {
+    g_pending_line = &input;
+    g_pending_cursor = x;
 }
 
-void line$reprint(std::string const& prompt, std::string const& input, int x) {
-    std::cout << "\x1b[2K\r" << prompt << line$color(input);
+void line$flush() {
+    if (!g_pending_line)
+        return;
+
+    TRACE_SCOPE("render");
 
-    if (x > 0)
-        std::cout << "\x1b[1G\x1b[" << std::to_string(x) << "C";
+    render$line(*g_pending_line, g_highlighter.colors(*g_pending_line), g_pending_cursor);
+    g_pending_line = nullptr;
 }
 
 void history$prev(int& x, int& y, bool& lup, std::string const& prompt, std::string& input) {
-    if (!g_history.size() || y >= g_history.size())
+    auto entry = history$at(y);
+
+    if (!entry)
         return;
 
     lup = true;
+    y++;
 
-    input = *(g_history.rbegin() + y++);
+    input = *entry;
     x = input.size();
 
-    line$reprint(prompt, input, x + prompt.size());
+    line$reprint(input, x);
 }
 
 void history$next(int& x, int& y, bool& lup, std::string const& prompt, std::string& input) {
@@ -84,151 +94,265 @@ void history$next(int& x, int& y, bool& lup, std::string const& prompt, std::str
         y--;
     }
 
-    input = y ? *(g_history.rbegin() + --y) : "";
+    input = y ? *history$at(--y) : "";
     x = input.size();
 
-    line$reprint(prompt, input, x + prompt.size());
+    line$reprint(input, x);
 }
 
-void terminal$ansi_handler(std::string const& prompt, int& x, int& y, std::string& input,
-                           bool& lup) {
-    char ansi[4];
-    auto count = read(STDIN_FILENO, &ansi, 3);
+size_t line$prev(std::string const& input, size_t x) {
+    // Step over a whole UTF-8 sequence.
+    while (x && (input[--x] & 0xC0) == 0x80)
+        ;
 
-    if (count == 0)
-        return;
+    return x;
+}
 
-    if (count <= 0) {
-        perror("read()");
-        exit(1);
-    }
+size_t line$next(std::string const& input, size_t x) {
+    while (x < input.size() && (input[++x] & 0xC0) == 0x80)
+        ;
 
-    ansi[count] = '\0';
+    return x;
+}
 
-    if (strcmp(ansi, "[A") == 0) {
-        // ARROW UP
-        history$prev(x, y, lup, prompt, input);
-        return;
+std::string line$paste(std::string_view text) {
+    // The editor holds a single line: line breaks and tabs become spaces, and other
+    // control characters are dropped rather than interpreted.
+    auto line = std::string {};
+    line.reserve(text.size());
+
+    for (auto c : text) {
+        if (c == '\n' || c == '\r' || c == '\t')
+            line += ' ';
+        else if (static_cast<unsigned char>(c) >= ' ' && c != '\x7f')
+            line += c;
     }
 
-    if (strcmp(ansi, "[B") == 0) {
-        // ARROW DOWN
-        history$next(x, y, lup, prompt, input);
-        return;
-    }
+    return line;
+}
 
-    if (strcmp(ansi, "[C") == 0) {
-        // ARROW RIGHT
-        if (x < input.size()) {
-            ++x;
-            std::cout << "\x1b[1C";
+void terminal$ansi_handler(KeyEvent const& event, std::string const& prompt, int& x, int& y,
+                           std::string& input, bool& lup) {
+    switch (event.code) {
+    case KeyCode::Up:
+        history$prev(x, y, lup, prompt, input);
+        break;
+    case KeyCode::Down:
+        history$next(x, y, lup, prompt, input);
+        break;
+    case KeyCode::Right:
+        if (static_cast<size_t>(x) < input.size())
+            line$reprint(input, x = line$next(input, x));
+        break;
+    case KeyCode::Left:
+        if (x > 0)
+            line$reprint(input, x = line$prev(input, x));
+        break;
+    case KeyCode::Delete:
+        if (static_cast<size_t>(x) < input.size()) {
+            input.erase(x, line$next(input, x) - x);
+            line$reprint(input, x);
         }
-        return;
+        break;
+    case KeyCode::PageUp:
+        if (history$at(y + 5))
+            y += 5;
+        break;
+    case KeyCode::PageDown:
+        history$prev(x, y, lup, prompt, input);
+        break;
+    case KeyCode::Home:
+        line$reprint(input, x = 0);
+        break;
+    case KeyCode::End:
+        line$reprint(input, x = input.size());
+        break;
+    default:
+        break;
     }
+}
+
+// Tab completion of the word before the cursor.
+struct Tab {
+    bool active;
+    Completion completion;
+    size_t cycle; // candidates shown so far
+};
+
+void tab$replace(Completion& completion, std::string const& text, std::string& input, int& x) {
+    input.replace(completion.start, completion.end - completion.start, text);
+    completion.end = completion.start + text.size();
+    x = completion.end;
+    line$reprint(input, x);
+}
+
+void tab$handle(Tab& tab, std::string& input, int& x) {
+    // The first Tab inserts what every candidate has in common, a single candidate is
+    // finished off. When that adds nothing, this and every further Tab cycle through
+    // the candidates.
+    if (!tab.active) {
+        auto completion = complete$word(input, x);
 
-    if (strcmp(ansi, "[D") == 0) {
-        // ARROW LEFT
-        if (x > 0) {
-            --x;
-            std::cout << "\x1b[1D";
+        if (!completion.size())
+            return;
+
+        tab = Tab { true, std::move(completion), 0 };
+
+        if (tab.completion.size() == 1) {
+            auto text = tab.completion.candidate(tab.completion.first);
+
+            tab.active = false;
+            tab$replace(tab.completion, text.ends_with('/') ? text : text + ' ', input, x);
+            return;
         }
-        return;
-    }
 
-    if (strcmp(ansi, "[3~") == 0) {
-        // DEL
-        if (input.size()) {
-            input.erase(x, 1);
-            line$reprint(prompt, input, x + prompt.size());
+        auto common = tab.completion.common();
+
+        if (common.size() > tab.completion.end - tab.completion.start) {
+            tab$replace(tab.completion, common, input, x);
+            return;
         }
-        return;
     }
 
-    if (strcmp(ansi, "[5~") == 0) {
-        // PGUP
-        if (y + 5 < g_history.size())
-            y += 5;
-        return;
-    }
+    auto& completion = tab.completion;
 
-    if (strcmp(ansi, "[6~") == 0) {
-        // PGDN
-        history$prev(x, y, lup, prompt, input);
-        return;
-    }
+    tab$replace(completion, completion.candidate(completion.first + tab.cycle++ % completion.size()),
+                input, x);
+}
 
-    if (strcmp(ansi, "[H") == 0) {
-        // HOME
-        if (x)
-            std::cout << "\x1b[" << x << "D";
+// Ctrl-R incremental search through the history.
+struct Search {
+    bool active, failed;
+    std::string query, original;
+    size_t age; // age of the entry being shown
+};
 
-        x = 0;
-        return;
-    }
+void search$update(Search& search, std::string& input, int& x, size_t from) {
+    // An empty query matches everything, the line is left alone until something is typed.
+    auto found = search.query.size() ? history$search(search.query, from) : std::nullopt;
 
-    if (strcmp(ansi, "[F") == 0) {
-        // END
-        if (x < input.size()) {
-            std::cout << "\x1b[" << (input.size() - x) << "C";
-            x = input.size();
-        }
-        return;
+    search.failed = search.query.size() && !found;
+
+    if (found) {
+        search.age = *found;
+        input = *history$at(search.age);
+        x = input.find(search.query);
     }
+
+    render$prompt((search.failed ? "(failed reverse-i-search)`" : "(reverse-i-search)`")
+                  + search.query + "': ");
+    line$reprint(input, x);
 }
 
-bool terminal$cache_fnames(std::string const& shadow, std::vector<std::string>& fnames) {
-    auto files
-        = std::vector<std::filesystem::path> { std::filesystem::directory_iterator(get$cwd()), {} };
+bool search$handle(Search& search, KeyEvent const& event, std::string const& prompt,
+                   std::string& input, int& x) {
+    // Returns false when the key ends the search and still has to be handled as usual.
+    auto chr = event.code == KeyCode::Text ? event.text[0] : '\0';
 
-    if (!files.size())
-        return false;
+    if (chr == 18) {
+        // CTRL+R again, the next older match
+        search$update(search, input, x, search.age + 1);
+        return true;
+    }
 
-    std::transform(files.begin(), files.end(), std::back_inserter(fnames),
-                   [](std::filesystem::path const& path) { return path.filename(); });
+    if (chr == g_term.c_cc[VERASE]) {
+        search.query.erase(line$prev(search.query, search.query.size()));
+        search$update(search, input, x, 0);
+        return true;
+    }
 
-    return !!fnames.size();
-}
+    if (event.code == KeyCode::Text && static_cast<unsigned char>(chr) >= ' ' && chr != '\x7f') {
+        search.query += event.text;
+        search$update(search, input, x, search.age);
+        return true;
+    }
 
-void terminal$autocomplete(int& x, std::vector<std::string>& fnames, std::string const& prompt,
-                           std::string& shadow, std::string& input, int c) {
-    if (!fnames.size())
-        if (!terminal$cache_fnames(shadow, fnames))
-            return;
+    search.active = false;
+    render$prompt(prompt);
 
-    auto index = c % fnames.size();
-    input = shadow + fnames[index];
-    x = input.size();
-    line$reprint(prompt, input, x + prompt.size());
+    if (chr == 7) {
+        // CTRL+G gives up and restores the line
+        input = search.original;
+        x = input.size();
+        line$reprint(input, x);
+        return true;
+    }
+
+    return false;
 }
 
 std::string get$input(std::string const& prompt) {
-    auto chr = char {};
-    auto input = std::string {};
-    auto shadow = std::string {};
-    auto fname_cache = std::vector<std::string> {};
+    TRACE_SCOPE("input");
 
-    auto x = 0, y = 0, z = 0;
+    auto input = std::string {};
+    auto x = 0, y = 0;
     auto lup = false;
+    auto search = Search {};
+    auto tab = Tab {};
 
     terminal$control();
 
+    // Commands may have been installed since the last prompt, so nothing lexed is reused.
+    g_highlighter = {};
+
     // Print prompt string before starting loop
-    std::cout << "\x1b[2K\x1b[1G" << prompt;
+    render$begin(prompt);
+
+    while (true) {
+        if (!input$pending())
+            line$flush();
+
+        auto event = input$next();
+        TRACE_SCOPE("key");
+
+        if (event.code == KeyCode::Closed)
+            break;
+
+        if (search.active && search$handle(search, event, prompt, input, x))
+            continue;
+
+        if (event.code == KeyCode::Paste) {
+            // The whole paste is one edit.
+            auto text = line$paste(event.text);
+
+            input.insert(x, text);
+
+            x += text.size();
+            y = 0;
+            tab.active = false;
+
+            line$reprint(input, x);
+            continue;
+        }
+
+        if (event.code != KeyCode::Text) {
+            // ANSI control characters
+            tab.active = false;
+            terminal$ansi_handler(event, prompt, x, y, input, lup);
+            continue;
+        }
+
+        auto chr = event.text[0];
 
-    while (read(STDIN_FILENO, &chr, 1) == 1) {
         // termios::c_cc is runtime; no switches ;(
         if (chr == g_term.c_cc[VEOF]) {
             // CTRL+D (EOF)
+            line$flush();
+            render$end();
             std::cout << "^D\x1b[1G\nbrandon shell exited\n\x1b[2K\x1b[1G";
             return "\x1b[EOF";
         }
 
         if (chr == g_term.c_cc[VINTR]) {
             // CTRL+C (SIGINT)
-            std::cout << "^C\n\x1b[1G" << prompt;
+            line$flush();
+            render$end();
+            std::cout << "^C\n";
+            render$begin(prompt);
 
-            x = y = z = 0;
-            input = shadow = "";
+            x = y = 0;
+            input = "";
+            tab.active = false;
 
             continue;
         }
@@ -236,10 +360,12 @@ std::string get$input(std::string const& prompt) {
         if (chr == g_term.c_cc[VERASE]) {
             // Backspace
             if (input.size() && x) {
-                input.erase(--x, 1);
-                shadow = input;
-                z = 0;
-                line$reprint(prompt, input, x + prompt.size());
+                auto prev = line$prev(input, x);
+
+                input.erase(prev, x - prev);
+                x = prev;
+                tab.active = false;
+                line$reprint(input, x);
             }
 
             continue;
@@ -249,37 +375,44 @@ std::string get$input(std::string const& prompt) {
             // CTRL+Backspace
         }
 
+        if (chr == 18) {
+            // CTRL+R
+            search = Search { true, false, "", input, 0 };
+            search$update(search, input, x, 0);
+            continue;
+        }
+
         if (chr == '\r') {
             // Return
+            line$flush();
+            render$end();
             std::cout << "\n\x1b[2K\x1b[1G";
             terminal$restore();
 
+#if DEBUG_RENDER
+            render$print_stats();
+#endif
+
             return input;
         }
 
         if (chr == '\t') {
             // Tab
-            terminal$autocomplete(x, fname_cache, prompt, shadow, input, z++);
+            tab$handle(tab, input, x);
             continue;
         }
 
-        if (chr == '\x1b') {
-            // ANSI control characters
-            shadow = input;
-            z = 0;
-            terminal$ansi_handler(prompt, x, y, input, lup);
-            continue;
-        }
+        input.insert(x, event.text);
 
-        input.insert(x, 1, chr);
-        shadow = input;
+        x += event.text.size();
+        y = 0;
+        tab.active = false;
 
-        x++;
-        y = z = 0;
-
-        line$reprint(prompt, input, x + prompt.size());
+        line$reprint(input, x);
     }
 
+    line$flush();
+
     return input;
 }
 }
\ No newline at end of file
@@ -12,5 +12,4 @@ void handle$sigint(int);
 
 extern termios g_term;
 extern termios g_oterm;
-extern std::vector<std::string> g_history;
 }
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <unordered_map>
@@ -6,12 +7,15 @@
 
 #include <string.h>
 
+#include "CommandTable.h"
+#include "Functions.h"
 #include "Interpreter.h"
 #include "System.h"
 #include "Tokenizer.h"
+#include "Trace.h"
 
 namespace BShell {
-std::unordered_map<TokenType, char*> TokenName = {
+std::unordered_map<TokenType, char const*> TokenName = {
     { NullToken, "NULL" },
     { String, "STRING" },
     { Equal, "EQUAL" },
@@ -26,65 +30,156 @@ std::unordered_map<TokenType, char*> TokenName = {
     { Eval, "EVAL" },
     { StickyRight, "STICKY_RIGHT" },
     { StickyLeft, "STICKY_LEFT" },
-    { WhiteSpace, "WHITESPACE" }
+    { WhiteSpace, "WHITESPACE" },
+    { Compound, "COMPOUND" },
+    { Function, "FUNCTION" }
 };
 
-std::unordered_set<std::string> g_keywords = {
-    "export", "cd", "jobs"
+// Reserved words shape the commands around them, every other keyword is a builtin in
+// Commands.cpp.
+std::unordered_set<std::string, StringHash, std::equal_to<>> g_keywords = {
+    "export", "cd",   "jobs",  "hash", "wait",  "fg",    "bg",    "pwd",   "pushd",
+    "popd",   "dirs", "true",  "false", "echo", "test",  "[",     "printf", "type",
+    "trace",  "time", "unset", "if",   "then",  "elif",  "else",  "fi",    "while",
+    "until",  "do",   "done",  "for",  "case",  "esac",  "break", "continue", "{",
+    "}",      "return", "alias", "unalias", "exit"
 };
 
-Tokenizer::Tokenizer(std::string const& input, bool preserve_whitespace)
-    : m_make_sticky_l()
-    , m_make_sticky_r()
-    , m_input(input)
-    , m_string_buf()
+// Where within `case word in pattern) list ;; esac` the tokenizer is. A pattern is
+// never a command, but the word after its ')' is.
+enum CaseState : uint8_t { NoCase, CaseWord, CasePattern, CaseBody };
+
+bool keyword$leads(std::string_view word) {
+    return word == "time" || word == "if" || word == "then" || word == "elif" || word == "else"
+        || word == "while" || word == "until" || word == "do" || word == "{";
+}
+
+int keyword$nesting(std::string_view word) {
+    if (word == "if" || word == "while" || word == "until" || word == "for" || word == "case"
+        || word == "{")
+        return 1;
+
+    if (word == "fi" || word == "done" || word == "esac" || word == "}")
+        return -1;
+
+    return 0;
+}
+
+bool keyword$closes(std::string_view word) {
+    return word == "then" || word == "elif" || word == "else" || word == "fi" || word == "do"
+        || word == "done" || word == "esac" || word == "}";
+}
+
+Tokenizer::Tokenizer(std::string_view input, bool preserve_whitespace, bool aliases)
+    : m_input(input)
+    , m_start()
+    , m_end()
     , m_quotes()
     , m_gobble()
     , m_force_string()
-    , m_tokens()
-    , m_preserve_whitespace(preserve_whitespace) {
+    , m_make_sticky_l()
+    , m_make_sticky_r()
+    , m_preserve_whitespace(preserve_whitespace)
+    , m_case(NoCase)
+    , m_aliases(aliases)
+    , m_uses_aliases()
+    , m_spans()
+    , m_checkpoints() {
     tokenize_input();
 }
 
+Tokenizer::Tokenizer(std::string_view input, Checkpoint const& checkpoint,
+                     std::function<bool(Checkpoint const&)> resync)
+    : m_input(input)
+    , m_start()
+    , m_end()
+    , m_quotes()
+    , m_gobble()
+    , m_force_string(checkpoint.force_string)
+    , m_make_sticky_l(checkpoint.sticky_l)
+    , m_make_sticky_r(checkpoint.sticky_r)
+    , m_preserve_whitespace(true)
+    , m_case(checkpoint.case_state)
+    , m_aliases(true)
+    , m_uses_aliases()
+    , m_spans()
+    , m_checkpoints()
+    , m_resync(std::move(resync)) {
+    tokenize_input(checkpoint.offset);
+}
+
+bool Checkpoint::same_state(Checkpoint const& other) const {
+    return force_string == other.force_string && sticky_l == other.sticky_l
+           && sticky_r == other.sticky_r && case_state == other.case_state;
+}
+
 std::vector<Token> Tokenizer::tokens() const {
+    // Owned tokens are only materialized here, one allocation per token.
+    auto tokens = std::vector<Token> {};
+
+    tokens.reserve(m_spans.size());
+
+    for (auto const& span : m_spans)
+        tokens.push_back(Token { span.type, std::string { view(span) } });
+
 #if DEBUG_TOKEN
     if (!m_preserve_whitespace) {
         std::cout << "--{Token Begin}--\n";
 
-        for (auto& t : m_tokens)
+        for (auto& t : tokens)
             std::cout << t << '\n';
 
         std::cout << "--{Token End}--\n";
     }
 #endif
 
-    return m_tokens;
+    return tokens;
+}
+
+std::span<TokenSpan const> Tokenizer::spans() const { return m_spans; }
+
+std::string_view Tokenizer::view(TokenSpan const& span) const {
+    if (span.offset >= m_input.size())
+        return std::string_view { m_aliased }.substr(span.offset - m_input.size(), span.length);
+
+    return m_input.substr(span.offset, span.length);
 }
 
-void Tokenizer::add_token(Token token) {
-    m_tokens.push_back(token);
-    m_string_buf = "";
+void Tokenizer::add_token(TokenType type, size_t begin, size_t end) {
+    m_spans.push_back(
+        TokenSpan { type, static_cast<uint32_t>(begin), static_cast<uint32_t>(end - begin) });
+    m_start = m_end = 0;
 }
 
-bool Tokenizer::add_quote(int index, int mask, std::string quote = "'") {
+bool Tokenizer::add_quote(int index, int mask, size_t pos) {
     m_quotes[index] += !(enquote() & mask);
 
-    if (enquote() & (0xF ^ mask) && m_string_buf.size())
+    if (enquote() & (0xF ^ mask) && m_end > m_start)
         add_string_buf();
 
     if (m_quotes[index] && !(m_quotes[index] % 2)) {
+        // The buffer starts at the opening quote, or at the '$' of "$(".
+        auto open = size_t { index == 3 ? 2u : 1u };
+        auto begin = m_end > m_start ? std::min(m_start + open, pos) : pos;
+
         if (m_preserve_whitespace)
-            // FIXME: This is very hackish
-            m_tokens.push_back(Token { WhiteSpace, index == 3 ? "$(" : quote });
+            m_spans.push_back(TokenSpan { WhiteSpace, static_cast<uint32_t>(begin - open),
+                                          static_cast<uint32_t>(open) });
 
-        add_token(Token { index <= 1 ? String : Eval,
-            (m_string_buf.size() >= 1) ? m_string_buf.substr(1) : m_string_buf });
+        add_token(index <= 1 ? String : Eval, begin, pos);
+        m_spans.back().quote = index == 0 ? '\'' : index == 1 ? '"' : 0;
 
         if (m_preserve_whitespace)
-            m_tokens.push_back(Token { WhiteSpace, quote });
+            m_spans.push_back(TokenSpan { WhiteSpace, static_cast<uint32_t>(pos), 1 });
 
         m_make_sticky_l = true;
 
+        // Forget closed quotes, a stale count would make the next quote of that kind
+        // nested in another one look like it is closing. Between tokens the state is
+        // then just the flags, which is what a Checkpoint keeps.
+        if (!enquote())
+            std::fill_n(m_quotes, 4, 0);
+
         return true;
     }
 
@@ -103,9 +198,10 @@ char Tokenizer::enquote() const {
 }
 
 void Tokenizer::add_string_buf() {
-    if (!m_string_buf.size())
+    if (m_end <= m_start)
         return;
 
+    auto word = m_input.substr(m_start, m_end - m_start);
     auto type = TokenType::String;
 
     if (m_make_sticky_r) {
@@ -118,36 +214,94 @@ void Tokenizer::add_string_buf() {
         m_make_sticky_l = false;
     }
 
-    if (g_keywords.contains(m_string_buf)) {
-        type = Key;
+    // An alias in command position is replaced by the tokens it was split into when
+    // it was defined. Highlighting only colors the word.
+    if (!m_force_string && m_aliases && type == String && m_case != CasePattern) {
+        if (auto const* alias = alias$find(word)) {
+            m_force_string = !alias->leads;
+            m_uses_aliases = true;
+
+            if (m_preserve_whitespace)
+                return add_token(Executable, m_start, m_end);
+
+            auto offset = static_cast<uint32_t>(m_input.size() + m_aliased.size());
+
+            m_aliased += alias->text;
+
+            for (auto span : alias->spans) {
+                span.offset += offset;
+                m_spans.push_back(span);
+            }
+
+            m_start = m_end = 0;
+            return;
+        }
+    }
+
+    // A keyword is only special in command position, `type echo` has one. A case
+    // pattern never is a command, the word after its ')' is. Functions come before
+    // builtins and commands, but not before reserved words.
+    if (m_case == CasePattern && word != "esac") {
+        m_force_string = !word.ends_with(')');
+
+        if (!m_force_string)
+            m_case = CaseBody;
+    } else if (!m_force_string && !keyword$leads(word) && !keyword$nesting(word)
+               && !keyword$closes(word) && function$find(word)) {
+        type = Function;
         m_force_string = true;
-    } else if (!m_force_string) {
-        auto path = get$executable_path(m_string_buf);
+    } else if ((!m_force_string || m_case == CasePattern) && g_keywords.contains(word)) {
+        type = Key;
+        m_force_string = !keyword$leads(word);
 
-        if (path.size()) {
+        m_uses_aliases |= word == "alias" || word == "unalias";
+
+        if (word == "case")
+            m_case = CaseWord;
+        else if (word == "esac")
+            m_case = NoCase;
+    } else if (!m_force_string) {
+        // A word that is no command yet may name a function defined later, the parser
+        // leaves that to be found out when it runs. `name()` is followed by the body of
+        // a definition, which starts with a keyword.
+        if (hash$lookup(word).size())
             type = Executable;
-            m_force_string = true;
-        }
+
+        m_force_string = !word.ends_with("()");
+    } else if (m_case == CaseWord && word == "in") {
+        m_case = CasePattern;
     }
 
-    add_token(Token { type, m_string_buf });
+    add_token(type, m_start, m_end);
 }
 
-void Tokenizer::tokenize_input() {
-    // Nothing to parse if empty string.
-    if (!m_input.size())
-        return;
+void Tokenizer::tokenize_input(size_t from) {
+    TRACE_SCOPE("tokenize");
 
     // Iterate through each character in the input
     // We use a one character look ahead to match any multi-character operators
-    for (auto const& c : m_input) {
+    // The current word is the range [m_start, m_end) of the input, no characters are copied.
+    for (auto i = from; i < m_input.size(); i++) {
+        auto const c = m_input[i];
+
+        // Highlighting remembers where lexing could restart after an edit.
+        if (m_preserve_whitespace && m_end <= m_start && !m_gobble && !enquote()) {
+            auto checkpoint = Checkpoint { static_cast<uint32_t>(i),
+                                           static_cast<uint32_t>(m_spans.size()), m_force_string,
+                                           m_make_sticky_l, m_make_sticky_r, m_case };
+
+            if (m_resync && m_resync(checkpoint))
+                return;
+
+            m_checkpoints.push_back(checkpoint);
+        }
+
         if (m_gobble) {
             m_gobble = false;
             continue;
         }
 
-        auto last = !(&*m_input.end() - &c - 1);
-        char* next = !last ? const_cast<char*>(&c + 1) : nullptr;
+        auto const* next = i + 1 < m_input.size() ? &m_input[i + 1] : nullptr;
 
         switch (c) {
         case ' ':
@@ -157,22 +311,25 @@ void Tokenizer::tokenize_input() {
             m_make_sticky_r = false;
             add_string_buf();
 
+            // Only a word right after a closing quote is glued to it.
+            m_make_sticky_l = false;
+
             if (m_preserve_whitespace)
-                m_tokens.push_back(Token { WhiteSpace, std::string { c } });
+                m_spans.push_back(TokenSpan { WhiteSpace, static_cast<uint32_t>(i), 1 });
 
             continue;
         case '\'':
-            if (add_quote(0, 0xE, "'"))
+            if (add_quote(0, 0xE, i))
                 continue;
 
             break;
         case '"':
-            if (add_quote(1, 0xD, "\""))
+            if (add_quote(1, 0xD, i))
                 continue;
 
             break;
         case '`':
-            if (add_quote(2, 0xB, "`"))
+            if (add_quote(2, 0xB, i))
                 continue;
 
             break;
@@ -180,13 +337,13 @@ void Tokenizer::tokenize_input() {
             if (next && *next == '(') {
                 m_gobble = true;
 
-                if (add_quote(3, 0x7, "$("))
+                if (add_quote(3, 0x7, i))
                     continue;
             }
             break;
         case ')':
             if (enquote() & 8)
-                if (add_quote(3, 0x7, ")"))
+                if (add_quote(3, 0x7, i))
                     continue;
             break;
         case '>':
@@ -194,6 +351,7 @@ void Tokenizer::tokenize_input() {
         case '|':
         case '=':
         case ';':
+        case '\n':
         case '&': {
             if (enquote())
                 break;
@@ -215,14 +373,16 @@ void Tokenizer::tokenize_input() {
                 type = RedirectPipe;
                 break;
             case '=':
+                // The value is never a command, `x=true` assigns a word.
                 if (!m_force_string) {
                     type = Equal;
-                    override_string = false;
+                    override_string = true;
                 } else {
                     pass = true;
                 }
                 break;
             case ';':
+            case '\n':
                 type = Sequential;
                 break;
             case '&':
@@ -236,10 +396,16 @@ void Tokenizer::tokenize_input() {
             }
 
             if (!pass) {
+                // Like whitespace, an operator ends the word before it.
+                m_make_sticky_r = false;
                 add_string_buf();
                 m_force_string = override_string;
 
-                add_token(Token { type, std::string { c } });
+                // `;;` ends the commands of a case pattern.
+                if (c == ';' && m_case == CaseBody && next && *next == ';')
+                    m_case = CasePattern;
+
+                add_token(type, i, i + (type == SequentialIf ? 2 : 1));
                 continue;
             } else
                 break;
@@ -247,13 +413,15 @@ void Tokenizer::tokenize_input() {
         }
 
         m_make_sticky_r = true;
-        m_string_buf += c;
 
-        if (last) {
-            m_make_sticky_r = false;
-            add_string_buf();
-        }
+        if (m_end <= m_start)
+            m_start = i;
+
+        m_end = i + 1;
     }
+
+    m_make_sticky_r = false;
+    add_string_buf();
 }
 
 std::ostream& operator<<(std::ostream& os, TokenType const& type) {
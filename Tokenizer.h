@@ -1,6 +1,9 @@
 #pragma once
 
+#include <functional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_set>
 #include <vector>
 
@@ -21,6 +24,8 @@ enum TokenType : uint16_t {
     StickyRight     = 1 << 11,  // sticky string (right), makes a string with next token
     StickyLeft      = 1 << 12,  // sticky string (left), makes a string with previous token
     WhiteSpace      = 1 << 13,  // whitespace
+    Compound        = 1 << 14,  // if, while, until, for, case, { or a definition, only made by the parser
+    Function        = 1 << 15,  // shell function, runs inside the shell
 };
 
 struct Token {
@@ -28,27 +33,76 @@ struct Token {
     std::string content;
 };
 
+// A token that refers back into the tokenizer's input instead of owning its content.
+struct TokenSpan {
+    TokenType type;
+    uint32_t offset, length;
+    char quote = 0; // the quote a String was enclosed in
+};
+
+// The tokenizer's state between two tokens, lexing can be resumed from here.
+struct Checkpoint {
+    uint32_t offset, spans;
+    bool force_string, sticky_l, sticky_r;
+    uint8_t case_state;
+
+    bool same_state(Checkpoint const&) const;
+};
+
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view> {}(str); }
+};
+
 class Tokenizer {
 public:
-    Tokenizer(std::string const&, bool = false);
+    // The input is not copied and must outlive the tokenizer. Aliases are expanded
+    // unless the last flag is false.
+    Tokenizer(std::string_view, bool = false, bool = true);
+    // Resumes highlighting-mode lexing of the input at a checkpoint of an earlier run, and
+    // stops early at the first checkpoint the predicate accepts.
+    Tokenizer(std::string_view, Checkpoint const&, std::function<bool(Checkpoint const&)> = {});
 
     std::vector<Token> tokens() const;
+    std::span<TokenSpan const> spans() const;
+    std::span<Checkpoint const> checkpoints() const { return m_checkpoints; }
+    std::string_view view(TokenSpan const&) const;
+    std::string_view input() const { return m_input; }
+    // The text of expanded aliases, spans past the end of the input point into it.
+    std::string_view aliased() const { return m_aliased; }
+    bool expects_command() const { return !m_force_string; }
+    // Whether an alias was expanded or the line runs alias or unalias, either way its
+    // parse depends on more than its text.
+    bool uses_aliases() const { return m_uses_aliases; }
 
 private:
-    void tokenize_input();
-    void add_token(Token);
-    bool add_quote(int, int, std::string);
+    void tokenize_input(size_t = 0);
+    void add_token(TokenType, size_t, size_t);
+    bool add_quote(int, int, size_t);
     char enquote() const;
     void add_string_buf();
 
-    std::string m_input, m_string_buf;
+    std::string_view m_input;
+    size_t m_start, m_end;
     int m_quotes[4];
     bool m_gobble, m_force_string, m_make_sticky_l, m_make_sticky_r, m_preserve_whitespace;
-    std::vector<Token> m_tokens;
+    uint8_t m_case; // CaseState, where within a case the input is
+    bool m_aliases, m_uses_aliases;
+    std::string m_aliased;
+    std::vector<TokenSpan> m_spans;
+    std::vector<Checkpoint> m_checkpoints;
+    std::function<bool(Checkpoint const&)> m_resync;
 };
 
 std::ostream& operator<<(std::ostream&, Token const&);
 std::ostream& operator<<(std::ostream&, TokenType const&);
 
-extern std::unordered_set<std::string> g_keywords;
+extern std::unordered_set<std::string, StringHash, std::equal_to<>> g_keywords;
+
+// Whether a command follows the reserved word, how it changes the nesting of compound
+// commands (+1 opens one, -1 closes one), and whether it ends the list of one.
+bool keyword$leads(std::string_view);
+int keyword$nesting(std::string_view);
+bool keyword$closes(std::string_view);
 }
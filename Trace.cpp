@@ -0,0 +1,99 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Trace.h"
+
+namespace BShell {
+bool g_trace_enabled = false;
+
+// The newest events, older ones are overwritten. Slots are claimed with one atomic
+// increment, so recording never takes a lock.
+constexpr auto g_trace_size = size_t { 1 } << 16;
+
+TraceEvent g_trace_events[g_trace_size];
+std::atomic<uint64_t> g_trace_next = 0;
+
+// BSHELL_TRACE=path dumps the trace to path when the shell that set it up exits.
+std::string g_trace_path;
+pid_t g_trace_pid = 0;
+
+uint64_t trace$now() {
+    auto now = timespec {};
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void trace$record(char const* name, uint64_t begin, uint64_t end) {
+    auto slot = g_trace_next.fetch_add(1, std::memory_order_relaxed);
+
+    g_trace_events[slot & (g_trace_size - 1)] = TraceEvent { name, begin, end };
+}
+
+void trace$enable(bool enable) { g_trace_enabled = enable; }
+
+void trace$clear() { g_trace_next = 0; }
+
+void trace$dump(std::ostream& os) {
+    // Chrome trace-event JSON, load it in chrome://tracing or Perfetto. Every event
+    // is a complete ("X") event, nested phases show up nested.
+    auto next = g_trace_next.load();
+    auto first = next > g_trace_size ? next - g_trace_size : 0;
+    auto pid = getpid();
+    auto precision = os.precision(3);
+    auto flags = os.setf(std::ios::fixed, std::ios::floatfield);
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    for (auto i = first; i < next; i++) {
+        auto const& event = g_trace_events[i & (g_trace_size - 1)];
+
+        os << (i != first ? ",\n" : "\n") << "{\"name\":\"" << event.name
+           << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << pid
+           << ",\"ts\":" << event.begin / 1e3 << ",\"dur\":" << (event.end - event.begin) / 1e3
+           << '}';
+    }
+
+    os << "\n]}\n";
+
+    os.precision(precision);
+    os.flags(flags);
+}
+
+void trace$exit() {
+    // Forked children exit through here too, only the shell writes the file.
+    if (getpid() != g_trace_pid)
+        return;
+
+    auto file = std::ofstream { g_trace_path };
+
+    if (!file) {
+        perror(g_trace_path.c_str());
+        return;
+    }
+
+    trace$dump(file);
+}
+
+void trace$init() {
+    auto* path = getenv("BSHELL_TRACE");
+
+    if (path == nullptr || !*path)
+        return;
+
+    g_trace_path = path;
+    g_trace_pid = getpid();
+
+    trace$enable(true);
+    std::atexit(trace$exit);
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+
+namespace BShell {
+// A phase of the shell's own work, in trace$now() nanoseconds.
+struct TraceEvent {
+    char const* name;
+    uint64_t begin, end;
+};
+
+void trace$init();
+void trace$enable(bool);
+void trace$clear();
+void trace$dump(std::ostream&);
+void trace$record(char const*, uint64_t, uint64_t);
+uint64_t trace$now();
+
+extern bool g_trace_enabled;
+
+// Records the lifetime of a scope as one event while tracing is enabled, otherwise it
+// costs a load and a branch.
+class TraceScope {
+public:
+    explicit TraceScope(char const* name)
+        : m_name(name)
+        , m_begin(g_trace_enabled ? trace$now() : 0) { }
+
+    ~TraceScope() {
+        if (m_begin)
+            trace$record(m_name, m_begin, trace$now());
+    }
+
+private:
+    char const* m_name;
+    uint64_t m_begin;
+};
+}
+
+// Builds without -D TRACE do not contain a single trace point.
+#if TRACE
+#define TRACE_NAME2(line) trace_scope_##line
+#define TRACE_NAME(line) TRACE_NAME2(line)
+#define TRACE_SCOPE(name) BShell::TraceScope TRACE_NAME(__LINE__) { name }
+#else
+#define TRACE_SCOPE(name)
+#endif
@@ -0,0 +1,234 @@
+#include <cctype>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Variables.h"
+
+extern char** environ;
+
+namespace BShell {
+// Open addressing with linear probing. A name is interned in m_names the first time it
+// is assigned and keeps its slot for good, unset only clears the slot, so there are no
+// tombstones and a probe never has to skip one.
+class VariableTable {
+public:
+    explicit VariableTable(char** env)
+        : m_slots(64)
+        , m_pid(getpid()) {
+        for (; env && *env; env++) {
+            auto entry = std::string_view { *env };
+            auto equal = entry.find('=');
+
+            if (equal != std::string_view::npos && var$valid(entry.substr(0, equal)))
+                set(entry.substr(0, equal), entry.substr(equal + 1), true);
+        }
+    }
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t name, length; // within m_names, length 0 for an empty slot
+        uint32_t value;        // within m_values
+        bool set, exported;
+    };
+
+    Slot* find(std::string_view name) {
+        auto& slot = m_slots[probe(name, hash_of(name))];
+
+        return slot.length ? &slot : nullptr;
+    }
+
+    Slot& insert(std::string_view name) {
+        auto hash = hash_of(name);
+        auto* slot = &m_slots[probe(name, hash)];
+
+        if (slot->length)
+            return *slot;
+
+        // Kept at most half full so probes stay short.
+        if ((m_count + 1) * 2 > m_slots.size()) {
+            grow();
+            slot = &m_slots[probe(name, hash)];
+        }
+
+        *slot = Slot { hash, static_cast<uint32_t>(m_names.size()),
+                       static_cast<uint32_t>(name.size()), static_cast<uint32_t>(m_values.size()),
+                       false, false };
+        m_names += name;
+        m_values.emplace_back();
+        m_count++;
+
+        return *slot;
+    }
+
+    void set(std::string_view name, std::string_view value, bool exported) {
+        auto& slot = insert(name);
+
+        slot.set = true;
+        slot.exported |= exported;
+        m_values[slot.value].assign(value);
+        m_stale |= slot.exported;
+    }
+
+    std::string_view name(Slot const& slot) const {
+        return std::string_view { m_names }.substr(slot.name, slot.length);
+    }
+
+    std::string const& value(Slot const& slot) const { return m_values[slot.value]; }
+
+    std::vector<Slot> const& slots() const { return m_slots; }
+
+    char* const* environ() {
+        if (!m_stale)
+            return m_envp.data();
+
+        // One block of NAME=value strings, the pointers are taken once it stopped growing.
+        auto offsets = std::vector<size_t> {};
+
+        m_env.clear();
+
+        for (auto const& slot : m_slots) {
+            if (!slot.length || !slot.set || !slot.exported)
+                continue;
+
+            offsets.push_back(m_env.size());
+            ((m_env += name(slot)) += '=') += value(slot);
+            m_env += '\0';
+        }
+
+        m_envp.clear();
+
+        for (auto offset : offsets)
+            m_envp.push_back(m_env.data() + offset);
+
+        m_envp.push_back(nullptr);
+        m_stale = false;
+
+        return m_envp.data();
+    }
+
+    void touch() { m_stale = true; }
+    pid_t pid() const { return m_pid; }
+
+private:
+    static uint32_t hash_of(std::string_view name) {
+        return static_cast<uint32_t>(std::hash<std::string_view> {}(name));
+    }
+
+    size_t probe(std::string_view name, uint32_t hash) const {
+        auto mask = m_slots.size() - 1;
+
+        for (auto i = hash & mask;; i = (i + 1) & mask) {
+            auto const& slot = m_slots[i];
+
+            if (!slot.length || (slot.hash == hash && this->name(slot) == name))
+                return i;
+        }
+    }
+
+    void grow() {
+        auto slots = std::vector<Slot>(m_slots.size() * 2);
+        auto mask = slots.size() - 1;
+
+        for (auto const& slot : m_slots) {
+            if (!slot.length)
+                continue;
+
+            auto i = slot.hash & mask;
+
+            while (slots[i].length)
+                i = (i + 1) & mask;
+
+            slots[i] = slot;
+        }
+
+        m_slots = std::move(slots);
+    }
+
+    std::string m_names;
+    std::deque<std::string> m_values; // a deque, so a value never moves once handed out
+    std::vector<Slot> m_slots;        // a power of two in size
+    size_t m_count = 0;
+
+    std::string m_env;
+    std::vector<char*> m_envp;
+    bool m_stale = true;
+
+    pid_t m_pid;
+};
+
+VariableTable& var$table() {
+    static auto table = VariableTable { environ };
+
+    return table;
+}
+
+bool var$valid(std::string_view name) {
+    if (name.empty() || std::isdigit(static_cast<unsigned char>(name[0])))
+        return false;
+
+    for (auto c : name)
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_')
+            return false;
+
+    return true;
+}
+
+char const* var$get(std::string_view name) {
+    auto* slot = var$table().find(name);
+
+    return slot && slot->set ? var$table().value(*slot).c_str() : nullptr;
+}
+
+void var$set(std::string_view name, std::string_view value, bool exported) {
+    var$table().set(name, value, exported);
+}
+
+bool var$export(std::string_view name) {
+    // Exporting a name that was never assigned marks it, it is exported once it is.
+    auto& slot = var$table().insert(name);
+
+    slot.exported = true;
+
+    if (slot.set)
+        var$table().touch();
+
+    return slot.set;
+}
+
+void var$unset(std::string_view name) {
+    auto* slot = var$table().find(name);
+
+    if (!slot)
+        return;
+
+    if (slot->set && slot->exported)
+        var$table().touch();
+
+    slot->set = slot->exported = false;
+}
+
+bool var$exported(std::string_view name) {
+    auto* slot = var$table().find(name);
+
+    return slot && slot->exported;
+}
+
+std::vector<std::string_view> var$names() {
+    auto names = std::vector<std::string_view> {};
+
+    for (auto const& slot : var$table().slots())
+        if (slot.length && slot.set)
+            names.push_back(var$table().name(slot));
+
+    return names;
+}
+
+char* const* var$environ() { return var$table().environ(); }
+
+pid_t var$pid() { return var$table().pid(); }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace BShell {
+// Shell variables, seeded from the environment the shell was started with. Only the
+// exported ones reach the environment of commands.
+char const* var$get(std::string_view);
+// Exported stays as it is unless the assignment exports.
+void var$set(std::string_view, std::string_view, bool = false);
+bool var$export(std::string_view);
+void var$unset(std::string_view);
+bool var$exported(std::string_view);
+std::vector<std::string_view> var$names();
+// The envp for exec, rebuilt only after an exported variable changed.
+char* const* var$environ();
+pid_t var$pid(); // $$
+bool var$valid(std::string_view);
+}
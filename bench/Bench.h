@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace BShell {
+// Keeps the optimizer from discarding a benchmarked result.
+template <typename T>
+inline void bench$keep(T const& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs fn until at least min_ns have elapsed and returns the mean ns per call.
+template <typename F>
+double bench$time(F&& fn, double min_ns = 2e8) {
+    using clock = std::chrono::steady_clock;
+
+    auto iterations = size_t { 1 };
+
+    while (true) {
+        auto start = clock::now();
+
+        for (auto i = size_t {}; i < iterations; i++)
+            fn();
+
+        auto ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        if (ns >= min_ns)
+            return ns / iterations;
+
+        iterations *= 2;
+    }
+}
+
+inline void bench$report(std::string const& name, double ns, double items, char const* unit) {
+    printf("%-32s %12.1f ns/op %14.0f %s/s\n", name.c_str(), ns, items * 1e9 / ns, unit);
+
+    // BENCH_JSON=path also appends each result to path as a JSON line, tagged with
+    // BENCH_REV, so runs of different versions can be compared.
+    auto* path = getenv("BENCH_JSON");
+
+    if (path == nullptr || !*path)
+        return;
+
+    if (auto* file = fopen(path, "a")) {
+        auto* rev = getenv("BENCH_REV");
+
+        fprintf(file,
+                "{\"revision\":\"%s\",\"name\":\"%s\",\"ns_per_op\":%.1f,\"per_second\":%.1f,"
+                "\"unit\":\"%s\"}\n",
+                rev ? rev : "", name.c_str(), ns, items * 1e9 / ns, unit);
+        fclose(file);
+    }
+}
+}
@@ -0,0 +1,59 @@
+#include <string>
+#include <vector>
+
+#include "../Interpreter.h"
+#include "../Jobs.h"
+#include "../Parser.h"
+#include "../Tokenizer.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+double bench$line(std::string const& line) {
+    auto tokenizer = Tokenizer(line);
+    auto ast = Parser(tokenizer).ast();
+
+    return bench$time([&] {
+        for (auto root : ast.roots())
+            handle$ast(ast.at(root));
+    });
+}
+
+int main() {
+    jobs$init(false);
+
+    // Each builtin against the binary it replaces, both with their output discarded.
+    struct {
+        char const *name, *builtin, *external;
+    } const lines[] = {
+        { "echo", "echo hello world > /dev/null", "/usr/bin/echo hello world > /dev/null" },
+        { "true", "true", "/usr/bin/true" },
+        { "false", "false", "/usr/bin/false" },
+        { "test", "test 1 -lt 2", "/usr/bin/test 1 -lt 2" },
+        { "[", "[ -d /tmp ]", "/usr/bin/[ -d /tmp ]" },
+        { "printf", "printf %s-%d x 42 > /dev/null", "/usr/bin/printf %s-%d x 42 > /dev/null" },
+        { "pwd", "pwd > /dev/null", "/usr/bin/pwd > /dev/null" },
+        { "type", "type ls > /dev/null", "/usr/bin/which ls > /dev/null" },
+    };
+
+    for (auto const& line : lines) {
+        bench$report(std::string { "builtin/" } + line.name, bench$line(line.builtin), 1, "runs");
+        bench$report(std::string { "external/" } + line.name, bench$line(line.external), 1,
+                     "runs");
+    }
+
+    // Assignments and expansion stay inside the shell's own variable table.
+    bench$report("variables/assign", bench$line("X=value"), 1, "runs");
+    bench$report("variables/expand", bench$line("true $HOME ${X:-default} $? x${X}y"), 4,
+                 "expansions");
+
+    // Loop bodies run from the AST, an iteration of builtins never forks. The words
+    // come from one substitution, so its fork is spread over all of them.
+    bench$report("loops/for", bench$line("for i in $(seq 1 10000); do X=$i; true; done"), 10000,
+                 "iterations");
+    bench$report("loops/while", bench$line("while false; do true; done"), 1, "runs");
+    bench$report("loops/case", bench$line("case hello.c in *.h) true;; *.c) true;; esac"), 1,
+                 "runs");
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+#include <string>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Complete.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+int main() {
+    // A directory of 100k files, the size where listing it on every Tab used to stall.
+    char dir[] = "/tmp/bshell-complete-XXXXXX";
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    auto count = 100000;
+    auto path = std::string { dir } + "/";
+
+    for (auto i = 0; i < count; i++) {
+        auto fd = open((path + "file" + std::to_string(i)).c_str(), O_WRONLY | O_CREAT, 0644);
+
+        if (fd >= 0)
+            close(fd);
+    }
+
+    auto line = "ls " + path + "file1234";
+    auto changed = path + "changed";
+
+    // Every Tab after the directory changed reads it again.
+    bench$report("complete/rescan (100k)", bench$time([&] {
+        close(open(changed.c_str(), O_WRONLY | O_CREAT, 0644));
+        unlink(changed.c_str());
+        bench$keep(complete$word(line, line.size()));
+    }), count, "entries");
+
+    bench$report("complete/cached (100k)",
+                 bench$time([&] { bench$keep(complete$word(line, line.size())); }), 1, "tabs");
+
+    auto command = std::string { "ech" };
+    complete$word(command, command.size());
+    bench$report("complete/command", bench$time([&] {
+        bench$keep(complete$word(command, command.size()));
+    }), 1, "tabs");
+
+    for (auto i = 0; i < count; i++)
+        unlink((path + "file" + std::to_string(i)).c_str());
+
+    rmdir(dir);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace BShell {
+// The command lines every stage is measured on. Generated rather than read from a file,
+// so every run and every version sees exactly the same input.
+struct CorpusLine {
+    char const* kind;
+    std::string line;
+};
+
+inline std::string bench$repeat(std::string const& part, size_t count) {
+    auto line = std::string {};
+
+    for (auto i = size_t {}; i < count; i++)
+        line += part;
+
+    return line;
+}
+
+inline std::vector<CorpusLine> bench$corpus() {
+    auto corpus = std::vector<CorpusLine> {
+        { "short", "ls" },
+        { "short", "echo hello world" },
+        { "short", "cd /tmp && ls -la; echo done" },
+        { "short", "sort -u < input.txt > /tmp/out.txt" },
+        { "short", "X=value" },
+    };
+
+    auto words = std::string { "ls" };
+
+    for (auto i = 0; i < 256; i++)
+        words += " --option-" + std::to_string(i) + "=value";
+
+    corpus.push_back({ "long", words });
+    corpus.push_back(
+        { "quoted", "echo" + bench$repeat(" 'single quoted' \"double quoted\" glued'to'\"gether\"", 32) });
+    corpus.push_back({ "substitutions", "echo" + bench$repeat(" $(cat list.txt) `date`", 32) });
+    corpus.push_back({ "pipeline", "cat input.txt" + bench$repeat(" | grep -v skip", 32) });
+
+    return corpus;
+}
+}
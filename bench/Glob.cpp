@@ -0,0 +1,71 @@
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../Glob.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+int main() {
+    // 100 directories of 1000 files, half of them matching.
+    char root[] = "/tmp/bshell-glob-XXXXXX";
+
+    if (!mkdtemp(root) || chdir(root) < 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    constexpr auto dirs = 100, files = 1000;
+
+    for (auto d = 0; d < dirs; d++) {
+        auto dir = "d" + std::to_string(d);
+
+        mkdir(dir.c_str(), 0755);
+
+        for (auto f = 0; f < files; f++) {
+            auto path = dir + "/f" + std::to_string(f) + (f % 2 ? ".c" : ".h");
+            close(open(path.c_str(), O_WRONLY | O_CREAT, 0644));
+        }
+    }
+
+    auto entries = dirs * (files + 1);
+
+    for (auto const* pattern : { "*/*.c", "d1*/f[0-4]*.h" }) {
+        bench$report(std::string { "glob/bshell " } + pattern, bench$time([&] {
+            auto paths = std::vector<std::string> {};
+            Glob { pattern }.expand(paths);
+            bench$keep(paths);
+        }), entries, "entries");
+
+        bench$report(std::string { "glob/glob(3) " } + pattern, bench$time([&] {
+            auto result = glob_t {};
+            glob(pattern, 0, nullptr, &result);
+            bench$keep(result);
+            globfree(&result);
+        }), entries, "entries");
+    }
+
+    bench$report("glob/bshell **/*.c", bench$time([&] {
+        auto paths = std::vector<std::string> {};
+        Glob { "**/*.c" }.expand(paths);
+        bench$keep(paths);
+    }), entries, "entries");
+
+    for (auto d = 0; d < dirs; d++) {
+        auto dir = "d" + std::to_string(d);
+
+        for (auto f = 0; f < files; f++)
+            unlink((dir + "/f" + std::to_string(f) + (f % 2 ? ".c" : ".h")).c_str());
+
+        rmdir(dir.c_str());
+    }
+
+    rmdir(root);
+}
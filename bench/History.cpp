@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../History.h"
+#include "Bench.h"
+
+using namespace BShell;
+using Clock = std::chrono::steady_clock;
+
+namespace BShell {
+// History.cpp only needs it when HISTFILE is unset.
+std::string get$home() { return "/tmp"; }
+}
+
+double bench$once(auto&& fn) {
+    auto start = Clock::now();
+    fn();
+
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+int main() {
+    // A million entries shaped like interactive use, with one rare command deep inside.
+    auto path = std::string { "/tmp/bshell-bench-history" };
+    auto entries = 1000000;
+    auto* file = fopen(path.c_str(), "w");
+
+    char const* commands[] = { "ls -la", "cd ..", "git status", "make -j8", "vim Shell.cpp",
+                               "grep -rn TODO .", "cat notes.txt | less", "./shell" };
+
+    for (auto i = 0; i < entries; i++) {
+        if (i == entries / 10)
+            fprintf(file, "rsync -avz build/ deploy@host:/srv/www\n");
+        else
+            fprintf(file, "%s %d\n", commands[i % 8], i % 997);
+    }
+
+    fclose(file);
+    setenv("HISTFILE", path.c_str(), 1);
+
+    bench$report("history/open (1M entries)", bench$once(history$open), 1, "opens");
+
+    bench$report("history/newest", bench$time([] { bench$keep(history$at(0)); }), 1, "lookups");
+
+    // The first search splits and indexes the whole file.
+    bench$report("history/first search", bench$once([] { bench$keep(history$search("rsync", 0)); }),
+                 1, "searches");
+
+    bench$report("history/search rare", bench$time([] { bench$keep(history$search("rsync", 0)); }),
+                 1, "searches");
+
+    bench$report("history/search common", bench$time([] { bench$keep(history$search("make", 0)); }),
+                 1, "searches");
+
+    bench$report("history/search missing",
+                 bench$time([] { bench$keep(history$search("docker", 0)); }), 1, "searches");
+
+    unlink(path.c_str());
+
+    return 0;
+}
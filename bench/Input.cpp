@@ -0,0 +1,149 @@
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Bench.h"
+
+using namespace BShell;
+using Clock = std::chrono::steady_clock;
+
+// Drives a shell through a pseudo-terminal, like a terminal emulator would.
+struct Terminal {
+    pid_t pid;
+    int fd;
+    std::string screen;
+};
+
+Terminal bench$spawn(char const* shell) {
+    auto size = winsize { 24, 80, 0, 0 };
+    auto term = Terminal { -1, -1 };
+
+    term.pid = forkpty(&term.fd, nullptr, nullptr, &size);
+
+    if (term.pid < 0) {
+        perror("forkpty()");
+        exit(1);
+    }
+
+    if (!term.pid) {
+        setenv("LOGNAME", "bench", 0);
+        execl(shell, shell, nullptr);
+        perror("execl()");
+        _exit(127);
+    }
+
+    return term;
+}
+
+bool bench$read(Terminal& term, int timeout) {
+    auto fd = pollfd { term.fd, POLLIN, 0 };
+
+    if (poll(&fd, 1, timeout) <= 0)
+        return false;
+
+    char buffer[65536];
+    auto count = read(term.fd, buffer, sizeof(buffer));
+
+    if (count <= 0)
+        return false;
+
+    term.screen.append(buffer, count);
+
+    return true;
+}
+
+void bench$drain(Terminal& term) {
+    while (bench$read(term, 100))
+        ;
+
+    term.screen.clear();
+}
+
+void bench$send(Terminal& term, std::string_view keys) {
+    while (keys.size()) {
+        auto count = write(term.fd, keys.data(), keys.size());
+
+        if (count <= 0) {
+            perror("write()");
+            exit(1);
+        }
+
+        keys.remove_prefix(count);
+    }
+}
+
+double bench$until(Terminal& term, std::string_view keys, std::string_view marker) {
+    // Time from sending the keys until the marker has been drawn.
+    auto start = Clock::now();
+
+    bench$send(term, keys);
+
+    while (term.screen.find(marker) == std::string::npos) {
+        if (!bench$read(term, 5000)) {
+            fprintf(stderr, "timed out waiting for the shell to draw \"%.*s\"\n",
+                    static_cast<int>(marker.size()), marker.data());
+            exit(1);
+        }
+    }
+
+    auto ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    term.screen.clear();
+
+    return ns;
+}
+
+int main(int argc, char** argv) {
+    auto term = bench$spawn(argc > 1 ? argv[1] : "./shell");
+    bench$drain(term);
+
+    // One key at a time, every key is a frame of its own.
+    auto keys = 256;
+    auto total = 0.0;
+
+    for (auto i = 0; i < keys; i++) {
+        auto key = std::string(1, 'a' + i % 26);
+        total += bench$until(term, key, key);
+    }
+
+    bench$report("input/keystroke", total / keys, 1, "keys");
+
+    bench$send(term, "\x03");
+    bench$drain(term);
+
+    auto text = std::string {};
+
+    while (text.size() < 10000)
+        text += "echo 'pasted text' ";
+
+    for (auto bracketed : { false, true }) {
+        auto marker = std::string { "END" } + (bracketed ? "B" : "U");
+        auto paste = text + marker;
+
+        if (bracketed)
+            paste = "\x1b[200~" + paste + "\x1b[201~";
+
+        auto ns = bench$until(term, paste, marker);
+
+        bench$report(bracketed ? "input/paste-bracketed (10KB)" : "input/paste-raw (10KB)", ns,
+                     text.size(), "bytes");
+
+        bench$send(term, "\x03");
+        bench$drain(term);
+    }
+
+    bench$send(term, "\x04");
+    bench$drain(term);
+
+    kill(term.pid, SIGHUP);
+    waitpid(term.pid, nullptr, 0);
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../Parser.h"
+#include "../Tokenizer.h"
+#include "Bench.h"
+#include "Corpus.h"
+
+using namespace BShell;
+
+size_t g_allocations = 0;
+
+void* operator new(size_t size) {
+    g_allocations++;
+
+    if (auto* ptr = malloc(size))
+        return ptr;
+
+    throw std::bad_alloc {};
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+int main() {
+    auto corpus = bench$corpus();
+
+    for (auto const& [kind, line] : corpus) {
+        auto tokenizer = Tokenizer(line);
+        auto before = g_allocations;
+        auto ast = Parser(tokenizer).ast();
+
+        bench$keep(ast);
+        printf("%-14s %-45.45s %4zu nodes %3zu allocations\n", kind, line.c_str(), ast.size(),
+               g_allocations - before);
+    }
+
+    // Each stage on its own, per kind of line.
+    auto kinds = std::map<std::string, std::vector<std::string>> {};
+
+    for (auto const& [kind, line] : corpus)
+        kinds[kind].push_back(line);
+
+    for (auto const& [kind, lines] : kinds) {
+        auto bytes = size_t {};
+
+        for (auto const& line : lines)
+            bytes += line.size();
+
+        bench$report("tokenizer/" + kind, bench$time([&] {
+            for (auto const& line : lines)
+                bench$keep(Tokenizer(line).spans());
+        }),
+                     bytes, "bytes");
+
+        auto tokenizers = std::vector<Tokenizer> {};
+
+        for (auto const& line : lines)
+            tokenizers.emplace_back(line);
+
+        bench$report("parser/" + kind, bench$time([&] {
+            for (auto const& tokenizer : tokenizers) {
+                auto ast = Parser(tokenizer).ast();
+                bench$keep(ast);
+            }
+        }),
+                     lines.size(), "lines");
+    }
+
+    auto before = g_allocations;
+    auto runs = size_t {};
+    auto ns = bench$time([&] {
+        for (auto const& [kind, line] : corpus) {
+            auto tokenizer = Tokenizer(line);
+            auto ast = Parser(tokenizer).ast();
+            bench$keep(ast);
+        }
+
+        runs++;
+    });
+
+    bench$report("parser/corpus", ns, corpus.size(), "lines");
+    printf("%-32s %12.1f allocations/line\n", "parser/corpus",
+           double(g_allocations - before) / (runs * corpus.size()));
+
+    return 0;
+}
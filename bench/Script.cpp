@@ -0,0 +1,83 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../Jobs.h"
+#include "../Script.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+std::string bench$script(std::string_view line, size_t count) {
+    auto script = std::string {};
+
+    for (auto i = size_t {}; i < count; i++)
+        script.append(line);
+
+    return script;
+}
+
+int main() {
+    jobs$init(false);
+
+    constexpr auto lines = size_t { 100000 };
+
+    // Splitting alone, with quotes, comments and continuations to scan.
+    auto source = bench$script("echo \"a b\" 'c d' $(e f) # g\\\n  h\tx | y\n", lines);
+    auto split = bench$time([&] {
+        auto reader = ScriptReader { source };
+
+        while (auto statement = reader.next())
+            bench$keep(statement);
+    });
+
+    bench$report("script/split", split / lines, 1, "statements");
+    bench$report("script/split", split / source.size(), 1, "bytes");
+
+    // Tokenizing, parsing and running a builtin per statement.
+    auto trues = bench$script("true\n", lines);
+    auto run = bench$time([&] {
+        auto reader = ScriptReader { trues };
+
+        bench$keep(script$run(reader));
+    });
+
+    bench$report("script/run true", run / lines, 1, "statements");
+
+    // The same script from a file, parsed every time against loaded from the cache.
+    char dir[] = "/tmp/bshell-bench-XXXXXX";
+
+    if (!mkdtemp(dir))
+        return 1;
+
+    auto path = std::string { dir } + "/script.sh";
+    auto* file = fopen(path.c_str(), "w");
+
+    fwrite(trues.data(), 1, trues.size(), file);
+    fclose(file);
+
+    setenv("XDG_CACHE_HOME", dir, 1);
+
+    auto run_file = [&](bool fresh) {
+        if (fresh)
+            system((std::string { "rm -rf " } + dir + "/bshell").c_str());
+
+        auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+        bench$keep(script$run_file(fd, path.c_str(), false));
+        close(fd);
+    };
+
+    bench$report("script/file parsed", bench$time([&] { run_file(true); }) / lines, 1,
+                 "statements");
+    bench$report("script/file cached", bench$time([&] { run_file(false); }) / lines, 1,
+                 "statements");
+
+    system((std::string { "rm -rf " } + dir).c_str());
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <string>
+#include <vector>
+
+#include "../CommandTable.h"
+#include "../Interpreter.h"
+#include "../Jobs.h"
+#include "../Parser.h"
+#include "../Tokenizer.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+double bench$line(std::string const& line, double min_ns = 2e8) {
+    auto tokenizer = Tokenizer(line);
+    auto ast = Parser(tokenizer).ast();
+
+    return bench$time([&] {
+        for (auto root : ast.roots())
+            handle$ast(ast.at(root));
+    }, min_ns);
+}
+
+int main() {
+    jobs$init(false);
+
+    // Resolving a command word, as the tokenizer does for every word in command position.
+    hash$lookup("ls");
+    bench$report("hash/hit", bench$time([] { bench$keep(hash$lookup("ls")); }), 1, "lookups");
+    bench$report("hash/miss", bench$time([] { bench$keep(hash$lookup("no-such-command")); }), 1,
+                 "lookups");
+
+    // From handle$ast to the exit status of the last process.
+    bench$report("spawn/true", bench$line("/bin/true"), 1, "runs");
+
+    for (auto depth : { 2, 8, 32 }) {
+        auto line = std::string { "/bin/true" };
+
+        for (auto i = 1; i < depth; i++)
+            line += " | /bin/true";
+
+        bench$report("spawn/pipeline-" + std::to_string(depth), bench$line(line), depth,
+                     "processes");
+    }
+
+    // Bytes through a three stage pipeline the shell set up.
+    auto bytes = size_t { 64 } << 20;
+    auto line = "head -c " + std::to_string(bytes) + " /dev/zero | cat | cat > /dev/null";
+
+    bench$report("pipeline/throughput (64MB)", bench$line(line, 1e9), bytes, "bytes");
+
+    return 0;
+}
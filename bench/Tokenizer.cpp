@@ -0,0 +1,82 @@
+#include <string>
+#include <vector>
+
+#include "../Highlight.h"
+#include "../Tokenizer.h"
+#include "Bench.h"
+
+using namespace BShell;
+
+std::string bench$long_line(size_t words) {
+    // Something shaped like a pasted one-liner: commands, quoting, substitutions and pipes.
+    auto line = std::string {};
+
+    for (auto i = size_t {}; i < words; i++) {
+        switch (i % 6) {
+        case 0:
+            line += "grep -e 'pattern " + std::to_string(i) + "' ";
+            break;
+        case 1:
+            line += "\"$HOME/some dir/file" + std::to_string(i) + ".txt\" ";
+            break;
+        case 2:
+            line += "$(cat list" + std::to_string(i) + ") ";
+            break;
+        case 3:
+            line += "| sort -u ";
+            break;
+        case 4:
+            line += "--flag=value" + std::to_string(i) + " ";
+            break;
+        case 5:
+            line += "&& echo done; ";
+            break;
+        }
+    }
+
+    return line;
+}
+
+int main() {
+    for (auto words : { 16, 256, 4096 }) {
+        auto line = bench$long_line(words);
+        auto count = Tokenizer(line).tokens().size();
+        auto suffix = " (" + std::to_string(line.size()) + "B)";
+
+        bench$report("tokenizer/tokens" + suffix, bench$time([&] {
+            auto tokens = Tokenizer(line).tokens();
+            bench$keep(tokens);
+        }),
+                     count, "tokens");
+
+        bench$report("tokenizer/spans" + suffix, bench$time([&] {
+            auto tokenizer = Tokenizer(line);
+            bench$keep(tokenizer.spans());
+        }),
+                     count, "tokens");
+
+        bench$report("tokenizer/highlight" + suffix, bench$time([&] {
+            auto tokenizer = Tokenizer(line, true);
+            bench$keep(tokenizer.spans());
+        }),
+                     count, "tokens");
+
+        // One keystroke typed and erased again, in the middle and at the end of the line.
+        for (auto [name, at] : { std::pair { "middle", line.size() / 2 },
+                                 std::pair { "end", line.size() } }) {
+            auto highlighter = Highlighter {};
+            auto edited = line;
+            highlighter.colors(edited);
+
+            bench$report("highlight/keystroke-" + std::string { name } + suffix, bench$time([&] {
+                edited.insert(at, 1, 'x');
+                bench$keep(highlighter.colors(edited));
+                edited.erase(at, 1);
+                bench$keep(highlighter.colors(edited));
+            }) / 2,
+                         1, "keys");
+        }
+    }
+
+    return 0;
+}